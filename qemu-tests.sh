@@ -296,9 +296,15 @@ function run_ordinary_test() {
     update_fstab $FSTAB
     umount_test_fs
 
+    # Some tests need kernel parameters of their own, like numa=fake
+    CMDLINE=""
+    if [ -f "$INITTAB-cmdline" ]; then
+        CMDLINE=$(cat "$INITTAB-cmdline")
+    fi
+
     TMPFILE=$(mktemp -u)
 
-    run_qemu $TMPFILE
+    run_qemu $TMPFILE "$CMDLINE"
     inspect $INSPECT $TMPFILE $INITTAB $FSTAB $?
     return $?
 }
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Each inittab entry runs on a cgroup of its own, under CGROUP_INIT_NAME,
+ * so a runaway entry can be capped instead of starving others - safe
+ * services included. Entries with an `id` get a cgroup of that name, others
+ * `entry@<n>`, n counting entries on inittab lists order - `@` is not valid
+ * on ids. Cgroups are created once, when inittab is read, and children join
+ * theirs before exec, see spawn.c */
+
+#include "cgroup.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "inittab.h"
+#include "log.h"
+#include "macros.h"
+#include "timeline.h"
+
+#define CGROUP_INIT_PATH CGROUP_ROOT "/" CGROUP_INIT_NAME
+
+static bool write_cgroup_file(const char *dir, const char *name,
+			      const char *value)
+{
+	char path[PATH_MAX];
+	int fd;
+	bool result = true;
+
+	(void)snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	errno = 0;
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		log_message("Could not open '%s': %m\n", path);
+		return false;
+	}
+
+	errno = 0;
+	if (write(fd, value, strlen(value)) < 0) {
+		log_message("Could not write '%s' to '%s': %m\n", value, path);
+		result = false;
+	}
+	(void)close(fd);
+
+	return result;
+}
+
+/* Controllers missing on kernel are just not available to entries */
+static void enable_controllers(const char *dir)
+{
+	(void)write_cgroup_file(dir, "cgroup.subtree_control", "+cpu");
+	(void)write_cgroup_file(dir, "cgroup.subtree_control", "+memory");
+}
+
+/* An existing path may be an interface file, like `cgroup.procs` */
+static bool make_cgroup_dir(const char *path)
+{
+	struct stat st;
+	int r;
+
+	errno = 0;
+	r = mkdir(path, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+	if (r == 0) {
+		return true;
+	} else if (errno != EEXIST) {
+		log_message("Could not create cgroup '%s': %m\n", path);
+		return false;
+	}
+
+	errno = 0;
+	if (stat(path, &st) < 0) {
+		log_message("Could not stat cgroup '%s': %m\n", path);
+		return false;
+	} else if (!S_ISDIR(st.st_mode)) {
+		log_message("Could not create cgroup '%s': not a directory\n",
+			    path);
+		return false;
+	}
+
+	return true;
+}
+
+/* A limit that can't be set is logged, entry still gets the cgroup */
+static void write_limits(const char *dir, const struct cgroup_limits *limits)
+{
+	char value[64];
+
+	if (limits->cpu_quota_us != 0U) {
+		(void)snprintf(value, sizeof(value), "%" PRIu32 " %" PRIu32,
+			       limits->cpu_quota_us, limits->cpu_period_us);
+		(void)write_cgroup_file(dir, "cpu.max", value);
+	}
+
+	if (limits->cpu_weight != 0U) {
+		(void)snprintf(value, sizeof(value), "%" PRIu32,
+			       limits->cpu_weight);
+		(void)write_cgroup_file(dir, "cpu.weight", value);
+	}
+
+	if (limits->memory_max != 0U) {
+		(void)snprintf(value, sizeof(value), "%" PRIu64,
+			       limits->memory_max);
+		(void)write_cgroup_file(dir, "memory.max", value);
+	}
+
+	if (limits->memory_high != 0U) {
+		(void)snprintf(value, sizeof(value), "%" PRIu64,
+			       limits->memory_high);
+		(void)write_cgroup_file(dir, "memory.high", value);
+	}
+}
+
+static void setup_entry_cgroup(struct inittab_entry *entry, unsigned int n)
+{
+	char path[sizeof(entry->cgroup)];
+
+	if (entry->id[0] != '\0') {
+		(void)snprintf(path, sizeof(path), "%s/%s", CGROUP_INIT_PATH,
+			       entry->id);
+	} else {
+		(void)snprintf(path, sizeof(path), "%s/entry@%u",
+			       CGROUP_INIT_PATH, n);
+	}
+
+	if (!make_cgroup_dir(path)) {
+		return;
+	}
+
+	write_limits(path, &entry->limits);
+	(void)strcpy(entry->cgroup, path);
+}
+
+void cgroup_setup(struct inittab *inittab)
+{
+	struct inittab_entry *lists[] = {inittab->startup_list,
+					 inittab->shutdown_list};
+	struct inittab_entry *entry;
+	unsigned int n = 0;
+	size_t i;
+
+	errno = 0;
+	if (access(CGROUP_ROOT "/cgroup.controllers", F_OK) < 0) {
+		log_message("No cgroup2 hierarchy on '%s', entries will run on "
+			    "init cgroup: %m\n",
+			    CGROUP_ROOT);
+		return;
+	}
+
+	timeline_record(TIMELINE_BEGIN, "cgroups", 0, 0);
+
+	enable_controllers(CGROUP_ROOT);
+	if (!make_cgroup_dir(CGROUP_INIT_PATH)) {
+		goto end;
+	}
+	enable_controllers(CGROUP_INIT_PATH);
+
+	for (i = 0; i < ARRAY_SIZE(lists); i++) {
+		for (entry = lists[i]; entry != NULL; entry = entry->next) {
+			setup_entry_cgroup(entry, n++);
+		}
+	}
+
+end:
+	timeline_record(TIMELINE_END, "cgroups", 0, 0);
+}
+
+void cgroup_cleanup(struct inittab *inittab)
+{
+	struct inittab_entry *lists[] = {inittab->startup_list,
+					 inittab->shutdown_list};
+	struct inittab_entry *entry;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(lists); i++) {
+		for (entry = lists[i]; entry != NULL; entry = entry->next) {
+			if (entry->cgroup[0] != '\0') {
+				(void)rmdir(entry->cgroup);
+				entry->cgroup[0] = '\0';
+			}
+		}
+	}
+
+	(void)rmdir(CGROUP_INIT_PATH);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef CGROUP_HEADER_
+#define CGROUP_HEADER_
+
+#include <stdint.h>
+
+/* Where cgroup2 is mounted, see mount.c */
+#ifndef CGROUP_ROOT
+#define CGROUP_ROOT "/sys/fs/cgroup"
+#endif
+
+/* Parent of entries cgroups, under CGROUP_ROOT */
+#ifndef CGROUP_INIT_NAME
+#define CGROUP_INIT_NAME "u-nit"
+#endif
+
+#ifndef DEFAULT_CPU_PERIOD
+#define DEFAULT_CPU_PERIOD 100000
+#endif
+
+/* Limits of an entry cgroup, written to its interface files. 0 if not set */
+struct cgroup_limits {
+	uint32_t cpu_quota_us; /* cpu.max, along with period */
+	uint32_t cpu_period_us;
+	uint32_t cpu_weight;
+	uint64_t memory_max; /* Bytes */
+	uint64_t memory_high;
+};
+
+struct inittab;
+
+/* Gives each startup and shutdown entry a cgroup of its own. Not fatal:
+ * entries whose cgroup couldn't be set up run on init cgroup */
+void cgroup_setup(struct inittab *inittab);
+/* Removes entries cgroups, if they have no processes left */
+void cgroup_cleanup(struct inittab *inittab);
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ttydefaults.h> /* CKILL, CINTR, CQUIT, ... */
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "console.h"
+
+/* Try to open the /dev/console, the maximum attempts is 10 times with
+ * 100000 microseconds between each attempt
+ */
+int open_console(const char *terminal, int mode)
+{
+	int times = 10;
+	int tty = -1;
+
+	for (; times > 0; times--) {
+		struct timespec pause = {};
+
+		errno = 0;
+		tty = open(terminal, mode);
+		if (tty >= 0) {
+			break;
+		}
+
+		if (errno != EIO) {
+			break;
+		}
+
+		/* Isn't this a really, really long time? */
+		pause.tv_nsec = 100 * 1000 * 1000; // 100 msecs
+		(void)nanosleep(&pause, NULL);
+	}
+
+	return tty;
+}
+
+bool reset_console(int fd)
+{
+	int r;
+	struct termios tty;
+	bool result = false;
+
+	r = tcgetattr(fd, &tty);
+	if (r == -1) {
+		goto end;
+	}
+
+	/* TODO assess what is really relevant to our case */
+	tty.c_cflag &= CBAUD | CBAUDEX | CSIZE | CSTOPB | PARENB | PARODD;
+	tty.c_cflag |= HUPCL | CLOCAL | CREAD;
+	tty.c_iflag = IGNPAR | ICRNL | IXON | IXANY;
+	tty.c_oflag = OPOST | ONLCR;
+	tty.c_lflag = ISIG | ICANON | ECHO | ECHOCTL | ECHOPRT | ECHOKE;
+
+	tty.c_cc[VINTR] = CINTR;   /* ^C */
+	tty.c_cc[VQUIT] = CQUIT;   /* ^\ */
+	tty.c_cc[VERASE] = CERASE; /* ASCII DEL (0177) */
+	tty.c_cc[VKILL] = CKILL;   /* ^X */
+	tty.c_cc[VEOF] = CEOF;     /* ^D */
+	tty.c_cc[VTIME] = 0;
+	tty.c_cc[VMIN] = 1;
+	tty.c_cc[VSTART] = CSTART; /* ^Q */
+	tty.c_cc[VSTOP] = CSTOP;   /* ^S */
+	tty.c_cc[VSUSP] = CSUSP;   /* ^Z */
+	tty.c_cc[VEOL] = _POSIX_VDISABLE;
+	tty.c_cc[VREPRINT] = CREPRINT; /* ^R */
+	tty.c_cc[VWERASE] = CWERASE;   /* ^W */
+	tty.c_cc[VLNEXT] = CLNEXT;     /* ^V */
+	tty.c_cc[VEOL2] = _POSIX_VDISABLE;
+
+	/*
+	 * Now set the terminal line.
+	 * We don't care about non-transmitted output data
+	 * and non-read input data.
+	 */
+	r = tcsetattr(fd, TCSANOW, &tty);
+	if (r == -1) {
+		goto end;
+	}
+
+	r = tcflush(fd, TCIOFLUSH);
+	if (r == -1) {
+		goto end;
+	}
+
+	/* Everything went OK */
+	result = true;
+
+end:
+	return result;
+}
@@ -0,0 +1,13 @@
+/*
+ * Copyright (C) 2017 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef CONSOLE_HEADER_
+#define CONSOLE_HEADER_
+
+#include <stdbool.h>
+
+int open_console(const char *terminal, int mode);
+bool reset_console(int fd);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#include "histogram.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+size_t histogram_bucket(uint64_t ns)
+{
+	size_t bucket;
+	uint64_t us = ns / 1000U;
+
+	if (us == 0U) {
+		return 0;
+	}
+
+	/* Position of highest bit set, counting from 1 */
+	bucket = 64U - (size_t)__builtin_clzll(us);
+	if (bucket >= HISTOGRAM_BUCKETS) {
+		bucket = HISTOGRAM_BUCKETS - 1U;
+	}
+
+	return bucket;
+}
+
+void histogram_add(struct histogram *h, uint64_t ns)
+{
+	assert(h != NULL);
+
+	h->count++;
+	h->total_ns += ns;
+	if (ns > h->max_ns) {
+		h->max_ns = ns;
+	}
+	h->buckets[histogram_bucket(ns)]++;
+}
+
+/* Only non empty buckets are dumped */
+void histogram_dump(const struct histogram *h, const char *name, int fd)
+{
+	size_t i;
+
+	assert(h != NULL);
+	assert(name != NULL);
+
+	(void)dprintf(fd, "%s: count %llu, avg %llu us, max %llu us\n", name,
+		      (unsigned long long)h->count,
+		      (unsigned long long)((h->count > 0U)
+					       ? (h->total_ns / h->count) / 1000U
+					       : 0U),
+		      (unsigned long long)(h->max_ns / 1000U));
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		if (h->buckets[i] == 0U) {
+			continue;
+		}
+
+		if (i == 0U) {
+			(void)dprintf(fd, "\t     < 1 us: %llu\n",
+				      (unsigned long long)h->buckets[i]);
+		} else if (i == (HISTOGRAM_BUCKETS - 1U)) {
+			(void)dprintf(fd, "\t>= %7llu us: %llu\n",
+				      1ULL << (i - 1U),
+				      (unsigned long long)h->buckets[i]);
+		} else {
+			(void)dprintf(fd, "\t < %7llu us: %llu\n", 1ULL << i,
+				      (unsigned long long)h->buckets[i]);
+		}
+	}
+}
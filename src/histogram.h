@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef HISTOGRAM_HEADER_
+#define HISTOGRAM_HEADER_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Latency histogram with log2 microseconds buckets: bucket 0 holds values
+ * below 1us, bucket N holds values in [2^(N-1), 2^N) us. Last bucket also
+ * holds anything bigger. */
+#define HISTOGRAM_BUCKETS 24
+
+struct histogram {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+size_t histogram_bucket(uint64_t ns);
+void histogram_add(struct histogram *h, uint64_t ns);
+void histogram_dump(const struct histogram *h, const char *name, int fd);
+
+#endif
@@ -5,14 +5,33 @@
 #include "inittab.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "lexer.h"
 #include "log.h"
 
 enum inittab_parse_result { RESULT_OK, RESULT_ERROR, RESULT_DONE };
 
+/* CPUs <core-id> field is checked against */
+#ifndef CPU_ONLINE_FILENAME
+#define CPU_ONLINE_FILENAME "/sys/devices/system/cpu/online"
+#endif
+
+/* Online NUMA nodes and CPUs of each one are read from there */
+#ifndef NODE_SYSFS_DIRNAME
+#define NODE_SYSFS_DIRNAME "/sys/devices/system/node"
+#endif
+
+/* Same as used by execvpe() when there's no PATH on environment */
+#ifndef DEFAULT_EXEC_PATH
+#define DEFAULT_EXEC_PATH "/bin:/usr/bin"
+#endif
+
 static bool safe_strtoi32_t(const char *s, int32_t *ret)
 {
 	char *end_ptr = NULL;
@@ -31,126 +50,1215 @@ static bool safe_strtoi32_t(const char *s, int32_t *ret)
 		*ret = (int32_t)l;
 	}
 
-	return result;
+	return result;
+}
+
+bool parse_cpu_list(const char *str, cpu_set_t *set)
+{
+	const char *p = str;
+
+	assert(str != NULL);
+	assert(set != NULL);
+
+	CPU_ZERO(set);
+
+	while (true) {
+		unsigned long first, last;
+		char *end;
+
+		if (!isdigit((unsigned char)*p)) {
+			return false;
+		}
+
+		errno = 0;
+		first = strtoul(p, &end, 10);
+		last = first;
+
+		if (*end == '-') {
+			p = end + 1;
+			if (!isdigit((unsigned char)*p)) {
+				return false;
+			}
+			last = strtoul(p, &end, 10);
+		}
+
+		if ((errno != 0) || (first > last) || (last >= CPU_SETSIZE)) {
+			return false;
+		}
+
+		for (; first <= last; first++) {
+			CPU_SET(first, set);
+		}
+
+		if (*end == '\0') {
+			return true;
+		} else if (*end != ',') {
+			return false;
+		}
+		p = end + 1;
+	}
+}
+
+/* Truncated if it doesn't fit */
+void format_cpu_list(const cpu_set_t *set, char *buf, size_t size)
+{
+	size_t len = 0;
+	int cpu = 0;
+
+	assert(set != NULL);
+	assert(size > 0U);
+
+	buf[0] = '\0';
+
+	while ((cpu < CPU_SETSIZE) && (len < size)) {
+		int last;
+
+		if (!CPU_ISSET(cpu, set)) {
+			cpu++;
+			continue;
+		}
+
+		last = cpu;
+		while ((last + 1 < CPU_SETSIZE) && CPU_ISSET(last + 1, set)) {
+			last++;
+		}
+
+		if (len > 0U) {
+			buf[len++] = ',';
+		}
+
+		if (last == cpu) {
+			len += (size_t)snprintf(buf + len, size - len, "%d", cpu);
+		} else {
+			len += (size_t)snprintf(buf + len, size - len, "%d-%d",
+						cpu, last);
+		}
+
+		cpu = last + 1;
+	}
+	buf[size - 1U] = '\0';
+
+	if (buf[0] == '\0') {
+		(void)snprintf(buf, size, "any");
+	}
+}
+
+/* Sets in CPU list format read from sysfs, like online CPUs */
+static bool read_list_file(const char *filename, cpu_set_t *set)
+{
+	char line[1024];
+	bool result = false;
+	FILE *fp;
+
+	errno = 0;
+	fp = fopen(filename, "re");
+	if (fp == NULL) {
+		log_message("Could not open '%s': %m\n", filename);
+		return false;
+	}
+
+	if (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		result = parse_cpu_list(line, set);
+	}
+	(void)fclose(fp);
+
+	if (!result) {
+		log_message("Could not read list from '%s'\n", filename);
+	}
+
+	return result;
+}
+
+struct online_set {
+	const char *filename;
+	cpu_set_t set;
+	bool read_done, available;
+};
+
+static struct online_set online_cpus = {.filename = CPU_ONLINE_FILENAME};
+static struct online_set online_nodes = {.filename =
+					     NODE_SYSFS_DIRNAME "/online"};
+
+/* Online CPUs or nodes are read once, when first needed. If that fails,
+ * every one is taken as online, and spawning entries will tell otherwise */
+static const cpu_set_t *online_set(struct online_set *online)
+{
+	if (!online->read_done) {
+		online->read_done = true;
+		online->available =
+		    read_list_file(online->filename, &online->set);
+	}
+
+	return online->available ? &online->set : NULL;
+}
+
+/* Offline CPUs or nodes are dropped. False if none is left */
+static bool keep_online(cpu_set_t *set, struct online_set *online,
+			const char *what)
+{
+	const cpu_set_t *online_now = online_set(online);
+	cpu_set_t kept;
+
+	if (online_now == NULL) {
+		return true;
+	}
+
+	CPU_AND(&kept, set, online_now);
+	if (CPU_COUNT(&kept) == 0) {
+		return false;
+	}
+
+	if (!CPU_EQUAL(&kept, set)) {
+		char list[64];
+
+		format_cpu_list(&kept, list, sizeof(list));
+		log_message("Offline %s ignored on inittab entry, using %s\n",
+			    what, list);
+		*set = kept;
+	}
+
+	return true;
+}
+
+static void add_entry_to_list(struct inittab_entry **list,
+			      struct inittab_entry *entry)
+{
+	struct inittab_entry *current;
+
+	assert(list != NULL);
+	assert(entry != NULL);
+
+	/* Add item to list ensuring entry->order is respected,
+	 * and keeping list stable - or, if a new item with same order
+	 * is added, it is kept after all previous items */
+	if ((*list == NULL) || ((*list)->order > entry->order)) {
+		entry->next = *list;
+		*list = entry;
+	} else {
+		current = *list;
+		while ((current->next != NULL) &&
+		       (current->next->order <= entry->order)) {
+			current = current->next;
+		}
+		entry->next = current->next;
+		current->next = entry;
+	}
+}
+
+static void debug_inittab_entry_list(const struct inittab_entry *list)
+{
+	if (list == NULL) {
+		log_message("\tNULL\n");
+	} else {
+		const struct inittab_entry *current = list;
+
+		while (current != NULL) {
+			char cpus[64];
+
+			format_cpu_list(&current->cpus, cpus, sizeof(cpus));
+			log_message(
+			    "\t[Entry] order: %d, cpus: %s, type: %d, "
+			    "controlling-terminal: '%s', process: '%s'\n",
+			    current->order, cpus, current->type,
+			    current->ctty_path, current->process_name);
+			current = current->next;
+		}
+	}
+}
+
+void debug_inittab_entries(const struct inittab *inittab_entries)
+{
+	log_message("STARTUP LIST:\n");
+	debug_inittab_entry_list(inittab_entries->startup_list);
+
+	log_message("SHUTDOWN LIST:\n");
+	debug_inittab_entry_list(inittab_entries->shutdown_list);
+
+	log_message("SAFE MODE:\n");
+	debug_inittab_entry_list(inittab_entries->safe_mode_entry);
+}
+
+static void free_inittab_entry(struct inittab_entry *entry)
+{
+	free_cmdline_contents(&entry->cmd);
+	free(entry->after);
+	free(entry->before);
+	free(entry);
+}
+
+void free_inittab_entry_list(struct inittab_entry *list)
+{
+	struct inittab_entry *tmp;
+
+	while (list != NULL) {
+		tmp = list;
+		list = list->next;
+		free_inittab_entry(tmp);
+	}
+}
+
+/* Looks for program on PATH, like execvpe() would. Entries may live on
+ * filesystems not mounted yet, so not finding it isn't an error: exec_path
+ * is left empty and the search is done again when spawning */
+static void resolve_exec_path(struct inittab_entry *entry)
+{
+	const char *program = entry->cmd.args[0];
+	const char *path, *next;
+	int r;
+
+	if (strchr(program, '/') != NULL) {
+		if (strlen(program) < sizeof(entry->exec_path)) {
+			(void)strcpy(entry->exec_path, program);
+		}
+		return;
+	}
+
+	path = getenv("PATH");
+	if (path == NULL) {
+		path = DEFAULT_EXEC_PATH;
+	}
+
+	for (; *path != '\0'; path = next) {
+		size_t len;
+
+		next = strchrnul(path, ':');
+		len = (size_t)(next - path);
+		if (*next == ':') {
+			next++;
+		}
+
+		/* Empty PATH element means current directory */
+		r = snprintf(entry->exec_path, sizeof(entry->exec_path),
+			     "%.*s%s%s", (int)len, path, (len > 0) ? "/" : "",
+			     program);
+		if ((r > 0) && ((size_t)r < sizeof(entry->exec_path)) &&
+		    (access(entry->exec_path, X_OK) == 0)) {
+			return;
+		}
+	}
+
+	log_message("Could not find '%s' on PATH yet\n", program);
+	entry->exec_path[0] = '\0';
+}
+
+static bool place_entry(struct inittab_entry *entry,
+			struct inittab *inittab_entries)
+{
+	bool result = true;
+
+	assert(entry != NULL);
+
+	switch (entry->type) {
+	case ONE_SHOT:
+	case SAFE_ONE_SHOT:
+	case SERVICE:
+	case SAFE_SERVICE: {
+		add_entry_to_list(&inittab_entries->startup_list, entry);
+		break;
+	}
+	case SHUTDOWN:
+	case SAFE_SHUTDOWN: {
+		add_entry_to_list(&inittab_entries->shutdown_list, entry);
+		break;
+	}
+	case SAFE_MODE: {
+		if (inittab_entries->safe_mode_entry != NULL) {
+			log_message("Safe process already defined before "
+				    "'%.20s'(...)\n",
+				    entry->process_name);
+			result = false;
+			break;
+		}
+		add_entry_to_list(&inittab_entries->safe_mode_entry, entry);
+		break;
+	}
+	default: {
+		/* Should never happen */
+		assert(false);
+		break;
+	}
+	}
+
+	return result;
+}
+
+/* Ids name entry cgroups too, see cgroup.c, so they can't be `.` or `..` */
+static bool is_valid_id(const char *id)
+{
+	const char *c;
+
+	if (!isalnum((unsigned char)id[0]) || (strlen(id) >= INITTAB_ID_MAX)) {
+		return false;
+	}
+
+	for (c = id; *c != '\0'; c++) {
+		if (!isalnum((unsigned char)*c) && (strchr("_-.", *c) == NULL)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool parse_id_option(struct inittab_entry *entry, const char *value)
+{
+	if (!is_valid_id(value)) {
+		log_message("Invalid 'id' option on inittab entry: '%s'\n",
+			    value);
+		return false;
+	}
+
+	(void)strcpy(entry->id, value);
+
+	return true;
+}
+
+/* Named entries are only known once whole inittab is read, see
+ * link_entries() */
+static bool parse_after_option(struct inittab_entry *entry, const char *value)
+{
+	char ids[sizeof(entry->after_ids)];
+	char *id, *saveptr = NULL;
+
+	if (strlen(value) >= sizeof(ids)) {
+		log_message("Option 'after' too big on inittab entry\n");
+		return false;
+	}
+
+	(void)strcpy(ids, value);
+	for (id = strtok_r(ids, ",", &saveptr); id != NULL;
+	     id = strtok_r(NULL, ",", &saveptr)) {
+		if (!is_valid_id(id)) {
+			log_message(
+			    "Invalid 'after' option on inittab entry: '%s'\n",
+			    value);
+			return false;
+		}
+	}
+
+	(void)strcpy(entry->after_ids, value);
+
+	return true;
+}
+
+static bool parse_ready_option(struct inittab_entry *entry, const char *value)
+{
+	if (strcmp(value, "spawn") == 0) {
+		entry->ready_notify = false;
+	} else if (strcmp(value, "notify") == 0) {
+		entry->ready_notify = true;
+	} else {
+		log_message("Invalid 'ready' option on inittab entry: '%s'\n",
+			    value);
+		return false;
+	}
+
+	return true;
+}
+
+static bool parse_timeout_option(struct inittab_entry *entry,
+				 const char *value)
+{
+	int32_t timeout;
+
+	if (!safe_strtoi32_t(value, &timeout) || (timeout <= 0)) {
+		log_message("Invalid 'timeout' option on inittab entry: '%s'\n",
+			    value);
+		return false;
+	}
+
+	entry->timeout_ms = (uint32_t)timeout;
+
+	return true;
+}
+
+static const char *const deadline_actions[] = {
+    [DEADLINE_WARN] = "warn",
+    [DEADLINE_PROCEED] = "proceed",
+    [DEADLINE_KILL] = "kill",
+    [DEADLINE_KILL_AND_SAFE_MODE] = "kill-and-safe-mode",
+    [DEADLINE_RETRY] = "retry"};
+
+static bool parse_on_timeout_option(struct inittab_entry *entry,
+				    const char *value)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(deadline_actions); i++) {
+		if (strcmp(value, deadline_actions[i]) == 0) {
+			entry->on_timeout = (enum deadline_action)i;
+			return true;
+		}
+	}
+
+	log_message("Invalid 'on-timeout' option on inittab entry: '%s'\n",
+		    value);
+
+	return false;
+}
+
+static bool parse_retries_option(struct inittab_entry *entry,
+				 const char *value)
+{
+	int32_t retries;
+
+	if (!safe_strtoi32_t(value, &retries) || (retries < 0)) {
+		log_message("Invalid 'retries' option on inittab entry: '%s'\n",
+			    value);
+		return false;
+	}
+
+	entry->retries = (uint32_t)retries;
+
+	return true;
+}
+
+static bool parse_restart_option(struct inittab_entry *entry,
+				 const char *value)
+{
+	if (strcmp(value, "never") == 0) {
+		entry->restart = RESTART_NEVER;
+	} else if (strcmp(value, "on-failure") == 0) {
+		entry->restart = RESTART_ON_FAILURE;
+	} else if (strcmp(value, "always") == 0) {
+		entry->restart = RESTART_ALWAYS;
+	} else {
+		log_message("Invalid 'restart' option on inittab entry: '%s'\n",
+			    value);
+		return false;
+	}
+
+	return true;
+}
+
+/* Positive number of milliseconds or times */
+static bool parse_positive_option(const char *name, const char *value,
+				  uint32_t *result)
+{
+	int32_t n;
+
+	if (!safe_strtoi32_t(value, &n) || (n <= 0)) {
+		log_message("Invalid '%s' option on inittab entry: '%s'\n", name,
+			    value);
+		return false;
+	}
+
+	*result = (uint32_t)n;
+
+	return true;
+}
+
+static bool parse_restart_delay_option(struct inittab_entry *entry,
+				       const char *value)
+{
+	return parse_positive_option("restart-delay", value,
+				     &entry->restart_delay_ms);
+}
+
+static bool parse_restart_limit_option(struct inittab_entry *entry,
+				       const char *value)
+{
+	return parse_positive_option("restart-limit", value,
+				     &entry->restart_limit);
+}
+
+static bool parse_restart_window_option(struct inittab_entry *entry,
+					const char *value)
+{
+	return parse_positive_option("restart-window", value,
+				     &entry->restart_window_ms);
+}
+
+static const struct {
+	const char *name;
+	int signal;
+} stop_signals[] = {{"TERM", SIGTERM}, {"INT", SIGINT},   {"HUP", SIGHUP},
+		    {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+		    {"USR2", SIGUSR2}};
+
+/* Signal name, without `SIG` prefix, or number */
+static bool parse_stop_signal_option(struct inittab_entry *entry,
+				     const char *value)
+{
+	int32_t signal;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(stop_signals); i++) {
+		if (strcmp(value, stop_signals[i].name) == 0) {
+			entry->stop_signal = stop_signals[i].signal;
+			return true;
+		}
+	}
+
+	if (!safe_strtoi32_t(value, &signal) || (signal <= 0) ||
+	    (signal >= NSIG)) {
+		log_message("Invalid 'stop-signal' option on inittab entry: "
+			    "'%s'\n",
+			    value);
+		return false;
+	}
+
+	entry->stop_signal = signal;
+
+	return true;
+}
+
+static bool parse_stop_timeout_option(struct inittab_entry *entry,
+				      const char *value)
+{
+	return parse_positive_option("stop-timeout", value,
+				     &entry->stop_timeout_ms);
+}
+
+static const struct {
+	const char *name;
+	int policy;
+} sched_policies[] = {{"other", SCHED_OTHER}, {"batch", SCHED_BATCH},
+		      {"idle", SCHED_IDLE},   {"fifo", SCHED_FIFO},
+		      {"rr", SCHED_RR},	      {"deadline", SCHED_DEADLINE}};
+
+static bool parse_sched_option(struct inittab_entry *entry, const char *value)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(sched_policies); i++) {
+		if (strcmp(value, sched_policies[i].name) == 0) {
+			entry->sched.policy = sched_policies[i].policy;
+			return true;
+		}
+	}
+
+	log_message("Invalid 'sched' option on inittab entry: '%s'\n", value);
+
+	return false;
+}
+
+static bool parse_sched_priority_option(struct inittab_entry *entry,
+					const char *value)
+{
+	int32_t priority;
+
+	if (!safe_strtoi32_t(value, &priority) || (priority < 1) ||
+	    (priority > 99)) {
+		log_message("Invalid 'sched-priority' option on inittab entry: "
+			    "'%s'\n",
+			    value);
+		return false;
+	}
+
+	entry->sched.priority = (uint32_t)priority;
+
+	return true;
+}
+
+static bool parse_sched_runtime_option(struct inittab_entry *entry,
+				       const char *value)
+{
+	return parse_positive_option("sched-runtime", value,
+				     &entry->sched.runtime_us);
+}
+
+static bool parse_sched_deadline_option(struct inittab_entry *entry,
+					const char *value)
+{
+	return parse_positive_option("sched-deadline", value,
+				     &entry->sched.deadline_us);
+}
+
+static bool parse_sched_period_option(struct inittab_entry *entry,
+				      const char *value)
+{
+	return parse_positive_option("sched-period", value,
+				     &entry->sched.period_us);
+}
+
+/* `io-priority` not given, out of valid levels */
+#define IO_PRIORITY_UNSET (SPAWN_IOPRIO_LEVEL_MAX + 1U)
+
+static const struct {
+	const char *name;
+	enum spawn_ioprio_class class;
+} io_classes[] = {{"realtime", SPAWN_IOPRIO_CLASS_RT},
+		  {"best-effort", SPAWN_IOPRIO_CLASS_BE},
+		  {"idle", SPAWN_IOPRIO_CLASS_IDLE}};
+
+static bool parse_io_class_option(struct inittab_entry *entry,
+				  const char *value)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(io_classes); i++) {
+		if (strcmp(value, io_classes[i].name) == 0) {
+			entry->ioprio.class = io_classes[i].class;
+			return true;
+		}
+	}
+
+	log_message("Invalid 'io-class' option on inittab entry: '%s'\n",
+		    value);
+
+	return false;
+}
+
+static bool parse_io_priority_option(struct inittab_entry *entry,
+				     const char *value)
+{
+	int32_t level;
+
+	if (!safe_strtoi32_t(value, &level) || (level < 0) ||
+	    (level > SPAWN_IOPRIO_LEVEL_MAX)) {
+		log_message("Invalid 'io-priority' option on inittab entry: "
+			    "'%s'\n",
+			    value);
+		return false;
+	}
+
+	entry->ioprio.level = (uint32_t)level;
+
+	return true;
+}
+
+/* Level alone means best-effort class, as ionice(1) does */
+static bool check_io_options(struct inittab_entry *entry)
+{
+	bool level_set = (entry->ioprio.level != IO_PRIORITY_UNSET);
+
+	if ((entry->ioprio.class == SPAWN_IOPRIO_CLASS_NONE) && level_set) {
+		entry->ioprio.class = SPAWN_IOPRIO_CLASS_BE;
+	}
+
+	switch (entry->ioprio.class) {
+	case SPAWN_IOPRIO_CLASS_IDLE:
+		if (level_set) {
+			log_message("Option 'io-priority' is not valid on "
+				    "'io-class=idle'\n");
+			return false;
+		}
+		entry->ioprio.level = 0;
+		break;
+	case SPAWN_IOPRIO_CLASS_NONE:
+		entry->ioprio.level = 0;
+		break;
+	default:
+		if (!level_set) {
+			entry->ioprio.level = SPAWN_IOPRIO_LEVEL_DEFAULT;
+		}
+		break;
+	}
+
+	return true;
+}
+
+/* Options can come in any order, so they are only checked together once
+ * all are read - better to refuse the entry now than to fail each spawn */
+static bool check_sched_options(const struct inittab_entry *entry)
+{
+	const struct spawn_sched *sched = &entry->sched;
+	bool realtime =
+	    (sched->policy == SCHED_FIFO) || (sched->policy == SCHED_RR);
+	bool deadline = (sched->policy == SCHED_DEADLINE);
+
+	if (realtime != (sched->priority != 0U)) {
+		log_message("Option 'sched-priority' is required by, and only "
+			    "valid on, 'sched=fifo' and 'sched=rr'\n");
+		return false;
+	}
+
+	if (!deadline) {
+		if ((sched->runtime_us != 0U) || (sched->deadline_us != 0U) ||
+		    (sched->period_us != 0U)) {
+			log_message("Options 'sched-runtime', 'sched-deadline' "
+				    "and 'sched-period' are only valid on "
+				    "'sched=deadline'\n");
+			return false;
+		}
+		return true;
+	}
+
+	if ((sched->runtime_us == 0U) || (sched->deadline_us == 0U)) {
+		log_message("Option 'sched=deadline' requires 'sched-runtime' "
+			    "and 'sched-deadline'\n");
+		return false;
+	}
+
+	if ((sched->runtime_us > sched->deadline_us) ||
+	    ((sched->period_us != 0U) &&
+	     (sched->deadline_us > sched->period_us))) {
+		log_message("Expected 'sched-runtime' <= 'sched-deadline' <= "
+			    "'sched-period' on inittab entry\n");
+		return false;
+	}
+
+	/* Deadline tasks must be able to run on every CPU */
+	if (CPU_COUNT(&entry->cpus) > 0) {
+		log_message("Option 'sched=deadline' is not valid with "
+			    "'core-id' field\n");
+		return false;
+	}
+
+	return true;
+}
+
+/* Microseconds of quota, optionally followed by `/` and period, as in
+ * `cpu-max=50000/100000` */
+static bool parse_cpu_max_option(struct inittab_entry *entry,
+				 const char *value)
+{
+	const char *slash = strchr(value, '/');
+	char quota_str[16];
+	int32_t quota, period = DEFAULT_CPU_PERIOD;
+	size_t len = (slash != NULL) ? (size_t)(slash - value) : strlen(value);
+
+	if (len >= sizeof(quota_str)) {
+		goto err;
+	}
+	(void)memcpy(quota_str, value, len);
+	quota_str[len] = '\0';
+
+	/* Bounds enforced by kernel */
+	if (!safe_strtoi32_t(quota_str, &quota) || (quota < 1000)) {
+		goto err;
+	}
+
+	if ((slash != NULL) &&
+	    (!safe_strtoi32_t(slash + 1, &period) || (period < 1000) ||
+	     (period > 1000000))) {
+		goto err;
+	}
+
+	entry->limits.cpu_quota_us = (uint32_t)quota;
+	entry->limits.cpu_period_us = (uint32_t)period;
+
+	return true;
+
+err:
+	log_message("Invalid 'cpu-max' option on inittab entry: '%s'\n", value);
+	return false;
+}
+
+static bool parse_cpu_weight_option(struct inittab_entry *entry,
+				    const char *value)
+{
+	int32_t weight;
+
+	if (!safe_strtoi32_t(value, &weight) || (weight < 1) ||
+	    (weight > 10000)) {
+		log_message("Invalid 'cpu-weight' option on inittab entry: "
+			    "'%s'\n",
+			    value);
+		return false;
+	}
+
+	entry->limits.cpu_weight = (uint32_t)weight;
+
+	return true;
+}
+
+/* Bytes, optionally followed by K, M or G, powers of 1024 */
+static bool parse_size(const char *str, uint64_t *result)
+{
+	static const char units[] = "KMG";
+	const char *unit;
+	char *end = NULL;
+	unsigned long long n;
+	unsigned int shift = 0;
+
+	errno = 0;
+	n = strtoull(str, &end, 10);
+	if ((*end != '\0') && ((unit = strchr(units, *end)) != NULL)) {
+		shift = 10U * (unsigned int)(unit - units + 1);
+		end++;
+	}
+
+	if ((errno != 0) || !isdigit((unsigned char)str[0]) ||
+	    (*end != '\0') || (n > (UINT64_MAX >> shift))) {
+		return false;
+	}
+
+	*result = (uint64_t)n << shift;
+
+	return true;
+}
+
+static bool parse_size_option(const char *name, const char *value,
+			      uint64_t *result)
+{
+	if (!parse_size(value, result) || (*result == 0U)) {
+		log_message("Invalid '%s' option on inittab entry: '%s'\n", name,
+			    value);
+		return false;
+	}
+
+	return true;
+}
+
+static bool parse_memory_max_option(struct inittab_entry *entry,
+				    const char *value)
+{
+	return parse_size_option("memory-max", value,
+				 &entry->limits.memory_max);
+}
+
+static bool parse_memory_high_option(struct inittab_entry *entry,
+				     const char *value)
+{
+	return parse_size_option("memory-high", value,
+				 &entry->limits.memory_high);
+}
+
+/* `infinity`, or a size for limits in bytes, or a count */
+static bool parse_rlimit_value(const char *str, bool bytes, rlim_t *result)
+{
+	uint64_t size;
+	int32_t n;
+
+	if (strcmp(str, "infinity") == 0) {
+		*result = RLIM_INFINITY;
+	} else if (bytes && parse_size(str, &size) && (size < RLIM_INFINITY)) {
+		*result = (rlim_t)size;
+	} else if (!bytes && safe_strtoi32_t(str, &n) && (n >= 0)) {
+		*result = (rlim_t)n;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/* Soft limit, optionally followed by `/` and hard limit. Without it, both
+ * are the same. Setting an option again replaces it */
+static bool parse_rlimit_option(struct inittab_entry *entry, const char *name,
+				 int resource, bool bytes, const char *value)
+{
+	const char *slash = strchr(value, '/');
+	char soft_str[32];
+	struct rlimit limit;
+	size_t i, len;
+
+	len = (slash != NULL) ? (size_t)(slash - value) : strlen(value);
+	if (len >= sizeof(soft_str)) {
+		goto err;
+	}
+	(void)memcpy(soft_str, value, len);
+	soft_str[len] = '\0';
+
+	if (!parse_rlimit_value(soft_str, bytes, &limit.rlim_cur)) {
+		goto err;
+	}
+
+	if (slash == NULL) {
+		limit.rlim_max = limit.rlim_cur;
+	} else if (!parse_rlimit_value(slash + 1, bytes, &limit.rlim_max) ||
+		   (limit.rlim_cur > limit.rlim_max)) {
+		goto err;
+	}
+
+	/* Open files can't go past fs.nr_open */
+	if ((resource == RLIMIT_NOFILE) && (limit.rlim_max == RLIM_INFINITY)) {
+		goto err;
+	}
+
+	for (i = 0; i < entry->rlimit_count; i++) {
+		if (entry->rlimits[i].resource == resource) {
+			break;
+		}
+	}
+
+	if (i == ARRAY_SIZE(entry->rlimits)) {
+		goto err;
+	}
+
+	entry->rlimits[i].resource = resource;
+	entry->rlimits[i].limit = limit;
+	if (i == entry->rlimit_count) {
+		entry->rlimit_count++;
+	}
+
+	return true;
+
+err:
+	log_message("Invalid '%s' option on inittab entry: '%s'\n", name,
+		    value);
+	return false;
+}
+
+static bool parse_limit_nofile_option(struct inittab_entry *entry,
+				      const char *value)
+{
+	return parse_rlimit_option(entry, "limit-nofile", RLIMIT_NOFILE, false,
+				   value);
+}
+
+static bool parse_limit_memlock_option(struct inittab_entry *entry,
+				       const char *value)
+{
+	return parse_rlimit_option(entry, "limit-memlock", RLIMIT_MEMLOCK,
+				   true, value);
+}
+
+static bool parse_limit_rtprio_option(struct inittab_entry *entry,
+				      const char *value)
+{
+	return parse_rlimit_option(entry, "limit-rtprio", RLIMIT_RTPRIO, false,
+				   value);
+}
+
+static bool parse_limit_stack_option(struct inittab_entry *entry,
+				     const char *value)
+{
+	return parse_rlimit_option(entry, "limit-stack", RLIMIT_STACK, true,
+				   value);
+}
+
+static bool parse_limit_core_option(struct inittab_entry *entry,
+				    const char *value)
+{
+	return parse_rlimit_option(entry, "limit-core", RLIMIT_CORE, true,
+				   value);
+}
+
+/* Same list format as <core-id>, offline nodes are dropped */
+static bool parse_numa_nodes_option(struct inittab_entry *entry,
+				    const char *value)
+{
+	cpu_set_t nodes;
+	size_t node;
+
+	if (!parse_cpu_list(value, &nodes)) {
+		log_message("Invalid 'numa-nodes' option on inittab entry: "
+			    "'%s'\n",
+			    value);
+		return false;
+	}
+
+	if (!keep_online(&nodes, &online_nodes, "nodes")) {
+		log_message("No node of 'numa-nodes' option on inittab entry "
+			    "is online: '%s'\n",
+			    value);
+		return false;
+	}
+
+	(void)memset(entry->mempolicy.nodes, 0,
+		     sizeof(entry->mempolicy.nodes));
+	for (node = 0; node < SPAWN_NODES_MAX; node++) {
+		if (CPU_ISSET(node, &nodes)) {
+			entry->mempolicy.nodes[node / SPAWN_NODE_BITS] |=
+			    1UL << (node % SPAWN_NODE_BITS);
+		}
+	}
+
+	return true;
+}
+
+static bool parse_numa_policy_option(struct inittab_entry *entry,
+				     const char *value)
+{
+	if (strcmp(value, "bind") == 0) {
+		entry->mempolicy.mode = MPOL_BIND;
+	} else if (strcmp(value, "preferred") == 0) {
+		entry->mempolicy.mode = MPOL_PREFERRED;
+	} else if (strcmp(value, "interleave") == 0) {
+		entry->mempolicy.mode = MPOL_INTERLEAVE;
+	} else {
+		log_message("Invalid 'numa-policy' option on inittab entry: "
+			    "'%s'\n",
+			    value);
+		return false;
+	}
+
+	return true;
 }
 
-static void add_entry_to_list(struct inittab_entry **list,
-			      struct inittab_entry *entry)
+static bool has_node(const struct spawn_mempolicy *mempolicy, size_t node)
 {
-	struct inittab_entry *current;
+	return (mempolicy->nodes[node / SPAWN_NODE_BITS] &
+		(1UL << (node % SPAWN_NODE_BITS))) != 0U;
+}
 
-	assert(list != NULL);
-	assert(entry != NULL);
+static size_t count_nodes(const struct spawn_mempolicy *mempolicy)
+{
+	size_t node, count = 0;
 
-	/* Add item to list ensuring entry->order is respected,
-	 * and keeping list stable - or, if a new item with same order
-	 * is added, it is kept after all previous items */
-	if ((*list == NULL) || ((*list)->order > entry->order)) {
-		entry->next = *list;
-		*list = entry;
-	} else {
-		current = *list;
-		while ((current->next != NULL) &&
-		       (current->next->order <= entry->order)) {
-			current = current->next;
+	for (node = 0; node < SPAWN_NODES_MAX; node++) {
+		if (has_node(mempolicy, node)) {
+			count++;
 		}
-		entry->next = current->next;
-		current->next = entry;
 	}
+
+	return count;
 }
 
-static void debug_inittab_entry_list(struct inittab_entry *list)
+/* Without <core-id>, entry runs on CPUs of its nodes. CPUs that can't be
+ * read are just left out */
+static void set_node_cpus(struct inittab_entry *entry)
 {
-	if (list == NULL) {
-		log_message("\tNULL\n");
-	} else {
-		struct inittab_entry *current = list;
+	char filename[PATH_MAX];
+	cpu_set_t cpus, node_cpus;
+	size_t node;
 
-		while (current != NULL) {
-			log_message(
-			    "\t[Entry] order: %d, core_id: %d, type: %d, "
-			    "controlling-terminal: '%s', process: '%s'\n",
-			    current->order, current->core_id, current->type,
-			    current->ctty_path, current->process_name);
-			current = current->next;
+	CPU_ZERO(&cpus);
+	for (node = 0; node < SPAWN_NODES_MAX; node++) {
+		if (!has_node(&entry->mempolicy, node)) {
+			continue;
+		}
+
+		(void)snprintf(filename, sizeof(filename), "%s/node%zu/cpulist",
+			       NODE_SYSFS_DIRNAME, node);
+		if (read_list_file(filename, &node_cpus)) {
+			CPU_OR(&cpus, &cpus, &node_cpus);
 		}
 	}
+
+	if ((CPU_COUNT(&cpus) > 0) &&
+	    keep_online(&cpus, &online_cpus, "CPUs")) {
+		entry->cpus = cpus;
+	}
 }
 
-static void debug_inittab_entries(struct inittab *inittab_entries)
+/* Nodes and policy come on separate options */
+static bool check_numa_options(struct inittab_entry *entry)
 {
-	log_message("STARTUP LIST:\n");
-	debug_inittab_entry_list(inittab_entries->startup_list);
+	size_t count = count_nodes(&entry->mempolicy);
 
-	log_message("SHUTDOWN LIST:\n");
-	debug_inittab_entry_list(inittab_entries->shutdown_list);
+	if (count == 0U) {
+		if (entry->mempolicy.mode != MPOL_DEFAULT) {
+			log_message("Option 'numa-policy' requires "
+				    "'numa-nodes'\n");
+			return false;
+		}
+		return true;
+	}
 
-	log_message("SAFE MODE:\n");
-	debug_inittab_entry_list(inittab_entries->safe_mode_entry);
+	if (entry->mempolicy.mode == MPOL_DEFAULT) {
+		entry->mempolicy.mode = MPOL_BIND;
+	} else if ((entry->mempolicy.mode == MPOL_PREFERRED) &&
+		   (count > 1U)) {
+		log_message("Option 'numa-policy=preferred' takes a single "
+			    "node\n");
+		return false;
+	}
+
+	/* Deadline tasks must be able to run on every CPU */
+	if ((CPU_COUNT(&entry->cpus) == 0) &&
+	    (entry->sched.policy != SCHED_DEADLINE)) {
+		set_node_cpus(entry);
+	}
+
+	return true;
 }
 
-void free_inittab_entry_list(struct inittab_entry *list)
+struct entry_option {
+	const char *name;
+	bool (*parse)(struct inittab_entry *entry, const char *value);
+};
+
+static const struct entry_option entry_options[] = {
+    {"id", parse_id_option},
+    {"after", parse_after_option},
+    {"ready", parse_ready_option},
+    {"timeout", parse_timeout_option},
+    {"on-timeout", parse_on_timeout_option},
+    {"retries", parse_retries_option},
+    {"restart", parse_restart_option},
+    {"restart-delay", parse_restart_delay_option},
+    {"restart-limit", parse_restart_limit_option},
+    {"restart-window", parse_restart_window_option},
+    {"stop-signal", parse_stop_signal_option},
+    {"stop-timeout", parse_stop_timeout_option},
+    {"sched", parse_sched_option},
+    {"sched-priority", parse_sched_priority_option},
+    {"sched-runtime", parse_sched_runtime_option},
+    {"sched-deadline", parse_sched_deadline_option},
+    {"sched-period", parse_sched_period_option},
+    {"io-class", parse_io_class_option},
+    {"io-priority", parse_io_priority_option},
+    {"cpu-max", parse_cpu_max_option},
+    {"cpu-weight", parse_cpu_weight_option},
+    {"memory-max", parse_memory_max_option},
+    {"memory-high", parse_memory_high_option},
+    {"limit-nofile", parse_limit_nofile_option},
+    {"limit-memlock", parse_limit_memlock_option},
+    {"limit-rtprio", parse_limit_rtprio_option},
+    {"limit-stack", parse_limit_stack_option},
+    {"limit-core", parse_limit_core_option},
+    {"numa-nodes", parse_numa_nodes_option},
+    {"numa-policy", parse_numa_policy_option}};
+
+/* Options are of the form <name>=<value>. Options found are set on
+ * `given`, a bit per entry_options index */
+static bool parse_entry_options(struct lexer_data *lexer,
+				struct inittab_entry *entry, uint64_t *given)
 {
-	struct inittab_entry *tmp;
+	enum token_result tr;
+	char *option, *value;
+	size_t i;
 
-	while (list != NULL) {
-		tmp = list;
-		list = list->next;
-		free(tmp);
+	while ((tr = next_token(lexer, &option, ' ', false, false)) !=
+	       TOKEN_END) {
+		if (tr == TOKEN_BLANK) {
+			continue;
+		}
+
+		value = strchr(option, '=');
+		if (value == NULL) {
+			log_message("Expected value for option '%s' on inittab "
+				    "entry\n",
+				    option);
+			return false;
+		}
+		*value++ = '\0';
+
+		for (i = 0; i < ARRAY_SIZE(entry_options); i++) {
+			if (strcmp(option, entry_options[i].name) == 0) {
+				break;
+			}
+		}
+
+		if (i == ARRAY_SIZE(entry_options)) {
+			log_message("Unknown option '%s' on inittab entry\n",
+				    option);
+			return false;
+		}
+
+		if (!entry_options[i].parse(entry, value)) {
+			return false;
+		}
+		*given |= (uint64_t)1 << i;
 	}
+
+	return true;
 }
 
-static bool place_entry(struct inittab_entry *entry,
-			struct inittab *inittab_entries)
+/* Options are checked on whether they were given, as their values may be
+ * the defaults */
+static bool option_given(uint64_t given, const char *name)
 {
-	bool result = true;
+	size_t i;
 
-	assert(entry != NULL);
+	assert(ARRAY_SIZE(entry_options) <= 64U);
 
-	switch (entry->type) {
-	case ONE_SHOT:
-	case SAFE_ONE_SHOT:
-	case SERVICE:
-	case SAFE_SERVICE: {
-		add_entry_to_list(&inittab_entries->startup_list, entry);
-		break;
-	}
-	case SHUTDOWN:
-	case SAFE_SHUTDOWN: {
-		add_entry_to_list(&inittab_entries->shutdown_list, entry);
-		break;
-	}
-	case SAFE_MODE: {
-		if (inittab_entries->safe_mode_entry != NULL) {
-			log_message("Safe process already defined before "
-				    "'%.20s'(...)\n",
-				    entry->process_name);
-			result = false;
-			break;
+	for (i = 0; i < ARRAY_SIZE(entry_options); i++) {
+		if (strcmp(name, entry_options[i].name) == 0) {
+			return (given & ((uint64_t)1 << i)) != 0U;
 		}
-		add_entry_to_list(&inittab_entries->safe_mode_entry, entry);
-		break;
-	}
-	default: {
-		/* Should never happen */
-		assert(false);
-		break;
-	}
 	}
 
-	return result;
+	return false;
 }
 
 static enum inittab_parse_result
 inittab_parse_entry(FILE *fp, struct inittab_entry *entry)
 {
 	char buf[BUFFER_LEN] = {};
-	struct lexer_data lexer = {};
+	struct lexer_data lexer = {}, options = {};
+	uint64_t given = 0;
+	char type_name[32];
 	enum inittab_parse_result result = RESULT_OK;
 	enum next_line_result next;
 	enum token_result tr;
 
-	char *order_str = NULL, *core_id_str = NULL, *type_str = NULL,
+	char *order_str = NULL, *cpus_str = NULL, *type_str = NULL,
 	     *process_str = NULL, *ctty_path_str = NULL;
 
 	if ((fp == NULL) || (feof(fp) != 0)) {
@@ -158,6 +1266,14 @@ inittab_parse_entry(FILE *fp, struct inittab_entry *entry)
 		goto end;
 	}
 
+	entry->retries = DEFAULT_RETRIES;
+	entry->restart_delay_ms = DEFAULT_RESTART_DELAY;
+	entry->restart_limit = DEFAULT_RESTART_LIMIT;
+	entry->restart_window_ms = DEFAULT_RESTART_WINDOW;
+	entry->stop_signal = SIGTERM;
+	entry->stop_timeout_ms = DEFAULT_STOP_TIMEOUT;
+	entry->ioprio.level = IO_PRIORITY_UNSET;
+
 	next = inittab_next_line(fp, buf);
 
 	if (next == NEXT_LINE_TOO_BIG) {
@@ -200,26 +1316,24 @@ inittab_parse_entry(FILE *fp, struct inittab_entry *entry)
 	}
 
 	/* Get <core_id> */
-	tr = next_token(&lexer, &core_id_str, ':', false, false);
+	tr = next_token(&lexer, &cpus_str, ':', false, false);
 	if (tr == TOKEN_BLANK) {
-		entry->core_id = -1;
+		CPU_ZERO(&entry->cpus);
 	} else if (tr == TOKEN_END) {
 		log_message("Invalid 'core_id' field on inittab entry\n");
 		result = RESULT_ERROR;
 		goto end;
-	} else {
-		if (!safe_strtoi32_t(core_id_str, &entry->core_id)) {
-			log_message(
-			    "Invalid 'core_id' field on inittab entry\n");
-			result = RESULT_ERROR;
-			goto end;
-		}
-		if (entry->core_id < 0) {
-			log_message(
-			    "Invalid 'core_id' field on inittab entry\n");
-			result = RESULT_ERROR;
-			goto end;
-		}
+	} else if (!parse_cpu_list(cpus_str, &entry->cpus)) {
+		log_message("Invalid 'core_id' field on inittab entry: '%s'\n",
+			    cpus_str);
+		result = RESULT_ERROR;
+		goto end;
+	} else if (!keep_online(&entry->cpus, &online_cpus, "CPUs")) {
+		log_message("No CPU of 'core_id' field on inittab entry is "
+			    "online: '%s'\n",
+			    cpus_str);
+		result = RESULT_ERROR;
+		goto end;
 	}
 
 	/*Get <type> */
@@ -229,6 +1343,24 @@ inittab_parse_entry(FILE *fp, struct inittab_entry *entry)
 		result = RESULT_ERROR;
 		goto end;
 	} else {
+		size_t len = strlen(type_str);
+		char *blank = strchr(type_str, ' ');
+
+		/* Entry options may follow type name, inside the brackets, as
+		 * in `<service id=foo>` */
+		if ((blank != NULL) && (type_str[len - 1] == '>')) {
+			type_str[len - 1] = '\0';
+			init_lexer(&options, blank + 1, strlen(blank + 1) + 1);
+			if (!parse_entry_options(&options, entry, &given)) {
+				result = RESULT_ERROR;
+				goto end;
+			}
+
+			(void)snprintf(type_name, sizeof(type_name), "%.*s>",
+				       (int)(blank - type_str), type_str);
+			type_str = type_name;
+		}
+
 		if (strcmp(type_str, "<one-shot>") == 0) {
 			entry->type = ONE_SHOT;
 		} else if (strcmp(type_str, "<safe-one-shot>") == 0) {
@@ -252,6 +1384,104 @@ inittab_parse_entry(FILE *fp, struct inittab_entry *entry)
 		}
 	}
 
+	/* Only services are considered started before they exit */
+	if (entry->ready_notify && !is_service_entry(entry)) {
+		log_message("Option 'ready' is only valid on services\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	/* Deadlines are for entries init waits for */
+	if ((option_given(given, "timeout") ||
+	     option_given(given, "on-timeout") ||
+	     option_given(given, "retries")) &&
+	    !is_waited_entry(entry)) {
+		log_message("Timeout options are only valid on one-shot "
+			    "entries and services with 'ready=notify'\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	/* Safe services exiting are handled by safe mode */
+	if ((option_given(given, "restart") ||
+	     option_given(given, "restart-delay") ||
+	     option_given(given, "restart-limit") ||
+	     option_given(given, "restart-window")) &&
+	    (entry->type != SERVICE)) {
+		log_message("Restart options are only valid on <service> "
+			    "entries\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	/* Shutdown entries and safe mode are left to run on termination */
+	if ((option_given(given, "stop-signal") ||
+	     option_given(given, "stop-timeout")) &&
+	    !is_startup_entry(entry)) {
+		log_message("Stop options are only valid on startup entries\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	if (!check_sched_options(entry)) {
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	if (!check_io_options(entry)) {
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	/* Safe mode process is run by its placeholder, see safe-mode.c */
+	if (((entry->limits.cpu_quota_us != 0U) ||
+	     (entry->limits.cpu_weight != 0U) ||
+	     (entry->limits.memory_max != 0U) ||
+	     (entry->limits.memory_high != 0U)) &&
+	    (entry->type == SAFE_MODE)) {
+		log_message("Cgroup options are not valid on <safe-mode> "
+			    "entry\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	if (!check_numa_options(entry)) {
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	if ((entry->rlimit_count != 0U) && (entry->type == SAFE_MODE)) {
+		log_message("Resource limit options are not valid on "
+			    "<safe-mode> entry\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	if ((entry->mempolicy.mode != MPOL_DEFAULT) &&
+	    (entry->type == SAFE_MODE)) {
+		log_message("NUMA options are not valid on <safe-mode> "
+			    "entry\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	if ((entry->ioprio.class != SPAWN_IOPRIO_CLASS_NONE) &&
+	    (entry->type == SAFE_MODE)) {
+		log_message("I/O priority options are not valid on <safe-mode> "
+			    "entry\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	/* Throttling above the hard limit would never happen */
+	if ((entry->limits.memory_max != 0U) &&
+	    (entry->limits.memory_high > entry->limits.memory_max)) {
+		log_message("Option 'memory-high' is above 'memory-max' on "
+			    "inittab entry\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
 	/* Now that we know entry type, check if it has a valid order */
 	if ((entry->order == -1) && (entry->type != SAFE_MODE)) {
 		log_message("Expected 'order' field on entry with type "
@@ -288,10 +1518,205 @@ inittab_parse_entry(FILE *fp, struct inittab_entry *entry)
 		goto end;
 	}
 
+	/* Better to refuse a malformed command line now than on every
+	 * spawn */
+	if (!parse_cmdline(entry->process_name, &entry->cmd)) {
+		log_message("Invalid command line on 'process' field on "
+			    "inittab entry\n");
+		result = RESULT_ERROR;
+		goto end;
+	}
+
+	resolve_exec_path(entry);
+
 end:
 	return result;
 }
 
+/* Dependencies are counted on a first pass, so their arrays are allocated
+ * once, and stored on a second one */
+static void add_dependency(struct inittab_entry *entry,
+			   struct inittab_entry *dependency, bool store)
+{
+	if (store) {
+		entry->after[entry->after_count] = dependency;
+		dependency->before[dependency->before_count] = entry;
+	}
+
+	entry->after_count++;
+	dependency->before_count++;
+}
+
+static bool alloc_dependencies(struct inittab_entry *list)
+{
+	struct inittab_entry *entry;
+
+	for (entry = list; entry != NULL; entry = entry->next) {
+		entry->after =
+		    calloc(entry->after_count, sizeof(struct inittab_entry *));
+		entry->before =
+		    calloc(entry->before_count, sizeof(struct inittab_entry *));
+		if (((entry->after == NULL) && (entry->after_count > 0U)) ||
+		    ((entry->before == NULL) && (entry->before_count > 0U))) {
+			log_message("Could not allocate inittab dependencies: "
+				    "%m\n");
+			return false;
+		}
+
+		entry->after_count = 0;
+		entry->before_count = 0;
+	}
+
+	return true;
+}
+
+static struct inittab_entry *find_entry(struct inittab_entry *list,
+					const char *id)
+{
+	for (; list != NULL; list = list->next) {
+		if (strcmp(list->id, id) == 0) {
+			return list;
+		}
+	}
+
+	return NULL;
+}
+
+static bool link_named_entries(struct inittab_entry *list,
+			       struct inittab_entry *entry, bool store)
+{
+	char ids[sizeof(entry->after_ids)];
+	char *id, *saveptr = NULL;
+
+	(void)strcpy(ids, entry->after_ids);
+	for (id = strtok_r(ids, ",", &saveptr); id != NULL;
+	     id = strtok_r(NULL, ",", &saveptr)) {
+		struct inittab_entry *dependency = find_entry(list, id);
+
+		if ((dependency == NULL) || (dependency == entry)) {
+			log_message("Entry '%s' can't be started after '%s': "
+				    "no such entry on its list\n",
+				    entry->process_name, id);
+			return false;
+		}
+
+		add_dependency(entry, dependency, store);
+	}
+
+	return true;
+}
+
+/* Entries without `after` option keep waiting for all one-shot ones - and
+ * services notifying readiness - of preceding orders, as if there was a
+ * barrier between orders */
+static void link_ordered_entries(struct inittab_entry *list,
+				 struct inittab_entry *entry, bool store)
+{
+	for (; (list != NULL) && (list->order < entry->order);
+	     list = list->next) {
+		if (is_waited_entry(list)) {
+			add_dependency(entry, list, store);
+		}
+	}
+}
+
+static bool link_entry(struct inittab_entry *list, struct inittab_entry *entry,
+		       bool store)
+{
+	if (entry->after_ids[0] != '\0') {
+		return link_named_entries(list, entry, store);
+	}
+
+	link_ordered_entries(list, entry, store);
+
+	return true;
+}
+
+/* Kahn's algorithm: if not all entries can be sorted, there's a cycle */
+static bool has_cycle(struct inittab_entry *list)
+{
+	struct inittab_entry *entry, *ready = NULL;
+	size_t i, sorted = 0, count = 0;
+
+	for (entry = list; entry != NULL; entry = entry->next) {
+		count++;
+		entry->waiting = entry->after_count;
+		if (entry->waiting == 0) {
+			entry->next_ready = ready;
+			ready = entry;
+		}
+	}
+
+	while (ready != NULL) {
+		entry = ready;
+		ready = entry->next_ready;
+		sorted++;
+
+		for (i = 0; i < entry->before_count; i++) {
+			struct inittab_entry *next = entry->before[i];
+
+			if (--next->waiting == 0) {
+				next->next_ready = ready;
+				ready = next;
+			}
+		}
+	}
+
+	return sorted != count;
+}
+
+/* Dependencies only make sense among entries of the same list */
+static bool link_entries(struct inittab_entry *list)
+{
+	struct inittab_entry *entry;
+
+	for (entry = list; entry != NULL; entry = entry->next) {
+		if ((entry->id[0] != '\0') &&
+		    (find_entry(list, entry->id) != entry)) {
+			log_message("Duplicated entry id '%s'\n", entry->id);
+			return false;
+		}
+
+		if (!link_entry(list, entry, false)) {
+			return false;
+		}
+	}
+
+	if (!alloc_dependencies(list)) {
+		return false;
+	}
+
+	/* Any error was found on first pass already */
+	for (entry = list; entry != NULL; entry = entry->next) {
+		(void)link_entry(list, entry, true);
+	}
+
+	if (has_cycle(list)) {
+		log_message("Cycle on inittab entries dependencies\n");
+		return false;
+	}
+
+	return true;
+}
+
+/* Ids are unique across lists too, as each entry cgroup is named after its
+ * id, see cgroup.c */
+static bool check_shared_ids(struct inittab_entry *startup_list,
+			     struct inittab_entry *shutdown_list)
+{
+	struct inittab_entry *entry;
+
+	for (entry = shutdown_list; entry != NULL; entry = entry->next) {
+		if ((entry->id[0] != '\0') &&
+		    (find_entry(startup_list, entry->id) != NULL)) {
+			log_message("Duplicated entry id '%s'\n", entry->id);
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool read_inittab(const char *filename, struct inittab *inittab_entries)
 {
 	FILE *fp = NULL;
@@ -324,14 +1749,17 @@ bool read_inittab(const char *filename, struct inittab *inittab_entries)
 
 		r = inittab_parse_entry(fp, entry);
 		if (r == RESULT_OK) {
-			log_message("[Entry] order: %d, core_id: %d, type: %d, "
+			char cpus[64];
+
+			format_cpu_list(&entry->cpus, cpus, sizeof(cpus));
+			log_message("[Entry] order: %d, cpus: %s, type: %d, "
 				    "controlling-terminal: '%s', process: "
 				    "'%s'\n",
-				    entry->order, entry->core_id, entry->type,
+				    entry->order, cpus, entry->type,
 				    entry->ctty_path, entry->process_name);
 
 			if (!place_entry(entry, inittab_entries)) {
-				free(entry);
+				free_inittab_entry(entry);
 				error = true;
 				exit_loop = true;
 			}
@@ -356,6 +1784,16 @@ bool read_inittab(const char *filename, struct inittab *inittab_entries)
 		log_message("No <safe-mode> entry on inittab. Can't go on!\n");
 		error = true;
 		/* TODO is this the right approach? */
+	} else if (inittab_entries->safe_mode_entry->after_ids[0] != '\0') {
+		log_message("<safe-mode> entry can't have 'after' option\n");
+		error = true;
+	}
+
+	if (!error && (!link_entries(inittab_entries->startup_list) ||
+		       !link_entries(inittab_entries->shutdown_list) ||
+		       !check_shared_ids(inittab_entries->startup_list,
+					 inittab_entries->shutdown_list))) {
+		error = true;
 	}
 
 	if (error) {
@@ -365,8 +1803,6 @@ bool read_inittab(const char *filename, struct inittab *inittab_entries)
 		free_inittab_entry_list(inittab_entries->startup_list);
 		free_inittab_entry_list(inittab_entries->shutdown_list);
 		free_inittab_entry_list(inittab_entries->safe_mode_entry);
-	} else {
-		debug_inittab_entries(inittab_entries);
 	}
 
 	errno = 0;
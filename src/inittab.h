@@ -5,10 +5,56 @@
 #ifndef INITTAB_HEADER_
 #define INITTAB_HEADER_
 
+#include <limits.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "cgroup.h"
+#include "cmdline.h"
+#include "spawn.h"
+
+#ifndef INITTAB_ID_MAX
+#define INITTAB_ID_MAX 64
+#endif
+
+#ifndef DEFAULT_RETRIES
+#define DEFAULT_RETRIES 1
+#endif
+
+/* What to do with an entry not started by its deadline: one-shot not exited
+ * or service not ready */
+enum deadline_action {
+	DEADLINE_WARN,    /* Just log it, keep waiting */
+	DEADLINE_PROCEED, /* Stop waiting, leave it running */
+	DEADLINE_KILL,    /* Kill it, entry is finished once it's gone */
+	DEADLINE_KILL_AND_SAFE_MODE,
+	DEADLINE_RETRY /* Kill it and start it again, up to `retries` times */
+};
+
+#ifndef DEFAULT_RESTART_DELAY
+#define DEFAULT_RESTART_DELAY 100
+#endif
+
+#ifndef DEFAULT_RESTART_LIMIT
+#define DEFAULT_RESTART_LIMIT 5
+#endif
+
+#ifndef DEFAULT_RESTART_WINDOW
+#define DEFAULT_RESTART_WINDOW 60000
+#endif
+
+/* Grace period of entries stopped on shutdown, before they are killed */
+#ifndef DEFAULT_STOP_TIMEOUT
+#define DEFAULT_STOP_TIMEOUT 3000
+#endif
+
+/* When a <service> is restarted once it exits */
+enum restart_policy { RESTART_NEVER, RESTART_ON_FAILURE, RESTART_ALWAYS };
+
+struct entry_state;
+
 enum inittab_entry_type {
 	ONE_SHOT,
 	SAFE_ONE_SHOT,
@@ -23,9 +69,49 @@ struct inittab_entry {
 	struct inittab_entry *next;
 	char process_name[4096];
 	char ctty_path[256];
+	/* process_name, parsed once when inittab is read */
+	struct cmdline_contents cmd;
+	/* Executable found on PATH for cmd. Empty if it couldn't be resolved
+	 * then, so it's searched again when spawning */
+	char exec_path[PATH_MAX];
 	int32_t order;
-	int32_t core_id;
+	cpu_set_t cpus; /* <core-id>, only online CPUs. Empty if not given */
+	struct spawn_sched sched; /* `sched` options */
+	struct spawn_ioprio ioprio; /* `io-*` options */
+	struct cgroup_limits limits;
+	struct spawn_mempolicy mempolicy; /* `numa-*` options */
+	struct spawn_rlimit rlimits[RLIM_NLIMITS]; /* `limit-*` options */
+	size_t rlimit_count;
+	/* Its cgroup directory, set by init. Empty if it has none */
+	char cgroup[PATH_MAX];
 	enum inittab_entry_type type;
+	char id[INITTAB_ID_MAX]; /* Empty if no `id` option */
+	char after_ids[256];     /* Raw `after` option, comma separated */
+	/* Service is only started once it notifies readiness, `ready=notify`
+	 * option */
+	bool ready_notify;
+	/* Deadline to start, from spawn, `timeout` option. 0 for default */
+	uint32_t timeout_ms;
+	enum deadline_action on_timeout;
+	uint32_t retries;
+	enum restart_policy restart;
+	uint32_t restart_delay_ms;  /* First delay, doubled on each restart */
+	uint32_t restart_limit;     /* Most restarts within restart window */
+	uint32_t restart_window_ms;
+	int stop_signal; /* Sent to stop it on shutdown */
+	uint32_t stop_timeout_ms;
+	/* Kept by init for startup entries */
+	struct entry_state *state;
+	/* Entries of same list that must finish before this one is started:
+	 * those named by `after` option or, without it, the waited ones of
+	 * preceding orders. `before` is the other way around */
+	struct inittab_entry **after;
+	size_t after_count;
+	struct inittab_entry **before;
+	size_t before_count;
+	/* Used by init while starting entries of the list */
+	size_t waiting; /* Entries on `after` not finished yet */
+	struct inittab_entry *next_ready;
 };
 
 struct inittab {
@@ -35,7 +121,11 @@ struct inittab {
 };
 
 bool read_inittab(const char *filename, struct inittab *inittab_entries);
+/* Kernel CPU list format, like "0,2-3" */
+bool parse_cpu_list(const char *str, cpu_set_t *set);
+void format_cpu_list(const cpu_set_t *set, char *buf, size_t size);
 void free_inittab_entry_list(struct inittab_entry *list);
+void debug_inittab_entries(const struct inittab *inittab_entries);
 
 static inline bool is_safe_entry(const struct inittab_entry *entry)
 {
@@ -66,4 +156,10 @@ static inline bool is_one_shot_entry(const struct inittab_entry *entry)
 	       (entry->type == SHUTDOWN) || (entry->type == SAFE_SHUTDOWN);
 }
 
+/* Entries whose start only finishes when they exit, or notify readiness */
+static inline bool is_waited_entry(const struct inittab_entry *entry)
+{
+	return is_one_shot_entry(entry) || entry->ready_notify;
+}
+
 #endif
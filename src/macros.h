@@ -6,6 +6,8 @@
 #ifndef MACROS_HEADER_
 #define MACROS_HEADER_
 
+#include <stddef.h>
+
 #ifdef __GNUC__
 #define FORMAT_PRINTF(fmt, arg) __attribute__((format(printf, fmt, arg)))
 #else
@@ -14,4 +16,7 @@
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
+#define CONTAINER_OF(ptr, type, member)                                        \
+	((type *)(void *)((char *)(ptr)-offsetof(type, member)))
+
 #endif /*__MACROS_H__*/
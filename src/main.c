@@ -5,35 +5,36 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <sched.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <sys/reboot.h>
 #include <sys/signalfd.h>
 #include <sys/stat.h>
-#include <sys/ttydefaults.h> /* CKILL, CINTR, CQUIT, ... */
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
-#include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
-#include "cmdline.h"
+#include "cgroup.h"
+#include "console.h"
 #include "inittab.h"
 #include "log.h"
 #include "mainloop.h"
 #include "mount.h"
+#include "notify.h"
+#include "process-table.h"
 #include "safe-mode.h"
+#include "spawn-server.h"
+#include "spawn.h"
+#include "timeline.h"
 #include "watchdog.h"
 
-#ifndef TIMEOUT_TERM
-#define TIMEOUT_TERM 3000
-#endif
-
+/* Default start deadline of entries init waits for, see `timeout` option */
 #ifndef TIMEOUT_ONE_SHOT
 #define TIMEOUT_ONE_SHOT 3000
 #endif
@@ -42,24 +43,41 @@
 #define INITTAB_FILENAME "/etc/inittab"
 #endif
 
+/* Restart backoff doubles up to this */
+#ifndef RESTART_DELAY_MAX
+#define RESTART_DELAY_MAX 30000
+#endif
+
+/* Where timeline is dumped to, once startup finishes, on SIGHUP and before
+ * reboot */
+#ifndef TIMELINE_FILENAME
+#define TIMELINE_FILENAME "/run/u-nit-timeline"
+#endif
+
+/* Where statistics are dumped to on SIGHUP */
+#ifndef STATS_FILENAME
+#define STATS_FILENAME "/run/u-nit-stats"
+#endif
+
 enum stage {
 	STAGE_SETUP,   /* Setting up the system, filesystems, etc */
 	STAGE_STARTUP, /* Starting applications defined on inittab */
 	STAGE_RUN, /* System is up and running. init is waiting on epoll loop */
-	STAGE_TERMINATION, /* Got signal to shutdown and is sending SIGTERM to
-			      processes */
+	STAGE_TERMINATION, /* Got signal to shutdown and is stopping startup
+			      entries */
 	STAGE_SHUTDOWN,    /* Running all shutdown process defined on inittab */
 	STAGE_CLOSE	/* Closing final resours before halt */
 };
 
-struct process {
-	struct process *next;
-	const struct inittab_entry *config;
-	pid_t pid;
-};
-
+/* Entries of list being started. An entry is started once all entries it
+ * comes after are finished: one-shot ones when they exit, services once
+ * spawned */
 struct remaining_entries {
-	struct inittab_entry *remaining;
+	struct inittab_entry *ready; /* Can be started, on next_ready */
+	struct inittab_entry **ready_tail;
+	uint32_t unfinished;
+	/* One-shot entries started, but not exited, and services started, but
+	 * not ready */
 	uint32_t pending_finish;
 };
 
@@ -67,12 +85,48 @@ static struct remaining_entries remaining;
 
 static struct inittab inittab_entries;
 
-static struct process *running_processes;
+static struct process_table running_processes;
 
-static enum stage current_stage;
+/* Exits of children reaped while spawn server requests were in flight. They
+ * may be of processes whose pids server didn't tell yet */
+struct early_exit {
+	struct early_exit *next;
+	siginfo_t info;
+};
+
+static struct early_exit *early_exits;
 
-static struct mainloop_timeout *kill_timeout;
-static struct mainloop_timeout *one_shot_timeout;
+/* Same for readiness notifications */
+struct early_ready {
+	struct early_ready *next;
+	pid_t pid;
+};
+
+static struct early_ready *early_readies;
+
+/* Kept by init for each startup entry, pointed by it */
+struct entry_state {
+	const struct inittab_entry *entry;
+	uint32_t running; /* Processes, counting the ones being spawned */
+	struct process *processes; /* Tracked ones, on `entry_next` */
+	/* Restart policy */
+	struct mainloop_timeout *restart_timeout;
+	bool gave_up;	  /* Restarted too often, it's left alone */
+	uint64_t started_ms; /* Last time it was spawned */
+	uint64_t window_start_ms;
+	uint32_t window_restarts;
+	uint32_t backoff; /* Restarts since it last ran for a whole window */
+	uint32_t restarts;
+	int last_code; /* si_code of its last exit, 0 if none */
+	int last_status;
+	/* Termination, stopped once entries coming after it are */
+	size_t stop_waiting; /* Entries on `before` not stopped yet */
+	bool stopping;
+	uint64_t stop_start_ms;
+	struct mainloop_timeout *kill_timeout;
+};
+
+static enum stage current_stage;
 
 static int safe_mode_pipe_fd;
 
@@ -80,6 +134,10 @@ static int shutdown_command = RB_AUTOBOOT; /* Is this a sensible default? */
 
 static bool safe_mode_on;
 
+static struct timespec init_start;
+
+static uint64_t shutdown_start_ms;
+
 #ifdef COMPILING_COVERAGE
 extern void __gcov_flush(void);
 #endif
@@ -95,55 +153,307 @@ __attribute__((noreturn)) static void panic(const char *msg)
 	_exit(1);
 }
 
-static void remove_process(struct process **list, struct process *p)
+/* Not on older C libraries, and an enum value on newer ones */
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+static uint64_t elapsed_ms(void)
+{
+	struct timespec now;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)(now.tv_sec - init_start.tv_sec) * 1000U +
+	       (uint64_t)((now.tv_nsec - init_start.tv_nsec) / 1000000);
+}
+
+static const char *const stage_names[] = {
+    [STAGE_SETUP] = "setup",	      [STAGE_STARTUP] = "startup",
+    [STAGE_RUN] = "run",	      [STAGE_TERMINATION] = "termination",
+    [STAGE_SHUTDOWN] = "shutdown", [STAGE_CLOSE] = "close"};
+
+static void set_stage(enum stage stage)
+{
+	current_stage = stage;
+	timeline_record(TIMELINE_STAGE, stage_names[stage], 0, 0);
+}
+
+static void dump_timeline(void *data)
 {
-	bool removed = false;
+	int fd;
 
-	assert(p != NULL);
-	assert(list != NULL);
-	assert(*list != NULL);
+	(void)data;
+
+	errno = 0;
+	fd = open(TIMELINE_FILENAME,
+		  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOCTTY,
+		  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0) {
+		log_message("Could not open timeline file '%s': %m\n",
+			    TIMELINE_FILENAME);
+		return;
+	}
+
+	timeline_dump(fd);
+	(void)close(fd);
+}
+
+static int sys_pidfd_open(pid_t pid, unsigned int flags)
+{
+	return (int)syscall(__NR_pidfd_open, pid, flags);
+}
+
+static int sys_pidfd_send_signal(int pidfd, int sig)
+{
+	return (int)syscall(__NR_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
 
-	if (p == *list) {
-		*list = (*list)->next;
-		removed = true;
+static void process_exit_cb(int fd, uint32_t events, void *data);
+static void process_spawned(const struct inittab_entry *entry, pid_t pid);
+
+/* Process exit is notified by its pidfd becoming readable. Without a pidfd
+ * (kernel older than 5.3), SIGCHLD handler still reaps it */
+static void watch_process(struct process *p)
+{
+	static bool pidfd_unsupported;
+
+	p->watch = NULL;
+	p->pidfd = -1;
+
+	if (pidfd_unsupported) {
+		return;
+	}
+
+	errno = 0;
+	p->pidfd = sys_pidfd_open(p->pid, 0);
+	if (p->pidfd < 0) {
+		if (errno == ENOSYS) {
+			log_message("pidfd not supported, relying on SIGCHLD "
+				    "only\n");
+			pidfd_unsupported = true;
+		} else {
+			log_message("Could not open pidfd for %d: %m\n",
+				    p->pid);
+		}
+		return;
+	}
+
+	p->watch = mainloop_add_fd(p->pidfd, MAINLOOP_FD_READ, process_exit_cb,
+				   p);
+	if (p->watch == NULL) {
+		log_message("Could not watch pidfd for %d\n", p->pid);
+		return;
+	}
+
+	mainloop_set_fd_priority(p->watch, MAINLOOP_PRIORITY_HIGH);
+}
+
+static void unwatch_process(struct process *p)
+{
+	if (p->watch != NULL) {
+		mainloop_remove_fd(p->watch);
+		p->watch = NULL;
+	}
+
+	if (p->pidfd >= 0) {
+		(void)close(p->pidfd);
+		p->pidfd = -1;
+	}
+}
+
+/* A pidfd always refers to our process, even if it was reaped and its pid
+ * reused */
+static void signal_process(struct process *p, int signal)
+{
+	int r;
+
+	errno = 0;
+	if (p->pidfd >= 0) {
+		r = sys_pidfd_send_signal(p->pidfd, signal);
 	} else {
-		struct process *current = *list;
+		r = kill(p->pid, signal);
+	}
 
-		while (current != NULL) {
-			if (current->next == p) {
-				current->next = p->next;
-				removed = true;
-				break;
-			}
-			current = current->next;
+	if ((r < 0) && (errno != ESRCH)) {
+		log_message("Could not send signal %d to %d: %m\n", signal,
+			    p->pid);
+	}
+}
+
+static enum process_kind process_kind_of(const struct inittab_entry *entry)
+{
+	if (entry->type == SAFE_MODE) {
+		return PROCESS_KIND_SAFE_MODE;
+	} else if (is_one_shot_entry(entry)) {
+		return PROCESS_KIND_ONE_SHOT;
+	}
+
+	return PROCESS_KIND_SERVICE;
+}
+
+/* Only fails if process table is full and can't grow */
+static bool add_process(struct process *p, const struct inittab_entry *entry)
+{
+	p->config = entry;
+	p->kind = process_kind_of(entry);
+
+	if (!process_table_add(&running_processes, p)) {
+		log_message("Could not track process %d (%s)\n", p->pid,
+			    entry->process_name);
+		return false;
+	}
+
+	/* So stopping an entry doesn't walk all processes */
+	if (entry->state != NULL) {
+		p->entry_next = entry->state->processes;
+		if (p->entry_next != NULL) {
+			p->entry_next->entry_pprev = &p->entry_next;
 		}
+		p->entry_pprev = &entry->state->processes;
+		entry->state->processes = p;
 	}
 
+	watch_process(p);
+
+	return true;
+}
+
+static void unlink_entry_process(struct process *p)
+{
+	if (p->entry_pprev == NULL) {
+		return;
+	}
+
+	*p->entry_pprev = p->entry_next;
+	if (p->entry_next != NULL) {
+		p->entry_next->entry_pprev = p->entry_pprev;
+	}
+	p->entry_next = NULL;
+	p->entry_pprev = NULL;
+}
+
+static void remove_process(struct process *p)
+{
+	if (p->deadline != NULL) {
+		mainloop_remove_timeout(p->deadline);
+	}
+
+	unlink_entry_process(p);
+	unwatch_process(p);
+	process_table_remove(&running_processes, p);
 	free(p);
-	assert(removed);
 }
 
-static void free_process_list(struct process **list)
+static void keep_early_exit(const siginfo_t *info)
 {
-	while (*list != NULL) {
-		remove_process(list, *list);
+	struct early_exit *e;
+
+	e = calloc(1, sizeof(struct early_exit));
+	if (e == NULL) {
+		log_message("Could not keep exit of %d: %m\n", info->si_pid);
+		return;
 	}
+
+	e->info = *info;
+	e->next = early_exits;
+	early_exits = e;
 }
 
-static void run_exec(struct cmdline_contents *cmd_contents)
+/* Returns true, filling `info`, if `pid` exited already */
+static bool take_early_exit(pid_t pid, siginfo_t *info)
 {
-#ifdef COMPILING_COVERAGE
-	__gcov_flush();
-	sync();
-#endif
-	errno = 0;
-	if (execvpe(cmd_contents->args[0], (char *const *)cmd_contents->args,
-		    (char *const *)cmd_contents->env) < 0) {
-		fprintf(stderr, "Could not exec process '%s': %m\n",
-			cmd_contents->args[0]);
+	struct early_exit **e;
+
+	for (e = &early_exits; *e != NULL; e = &(*e)->next) {
+		if ((*e)->info.si_pid == pid) {
+			struct early_exit *tmp = *e;
+
+			*info = tmp->info;
+			*e = tmp->next;
+			free(tmp);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Those left once all requests were answered were orphans */
+static void free_early_exits(void)
+{
+	struct early_exit *tmp;
+
+	while (early_exits != NULL) {
+		tmp = early_exits;
+		early_exits = tmp->next;
+		log_message("Reaped unknown process %d\n", tmp->info.si_pid);
+		free(tmp);
+	}
+}
+
+static void keep_early_ready(pid_t pid)
+{
+	struct early_ready *e;
+
+	e = calloc(1, sizeof(struct early_ready));
+	if (e == NULL) {
+		log_message("Could not keep readiness of %d: %m\n", pid);
+		return;
+	}
+
+	e->pid = pid;
+	e->next = early_readies;
+	early_readies = e;
+}
+
+/* Returns true if `pid` notified readiness already */
+static bool take_early_ready(pid_t pid)
+{
+	struct early_ready **e;
+
+	for (e = &early_readies; *e != NULL; e = &(*e)->next) {
+		if ((*e)->pid == pid) {
+			struct early_ready *tmp = *e;
+
+			*e = tmp->next;
+			free(tmp);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void free_early_readies(void)
+{
+	struct early_ready *tmp;
+
+	while (early_readies != NULL) {
+		tmp = early_readies;
+		early_readies = tmp->next;
+		log_message("Readiness notified by unknown process %d\n",
+			    tmp->pid);
+		free(tmp);
 	}
 }
 
+static void free_processes(void)
+{
+	enum process_kind kind;
+
+	for (kind = 0; kind < PROCESS_KINDS; kind++) {
+		struct process *p;
+
+		while ((p = process_table_first(&running_processes, kind)) !=
+		       NULL) {
+			remove_process(p);
+		}
+	}
+
+	process_table_free(&running_processes);
+}
+
 /*
  * This function duplicates fd on a file descriptor whose number
  * is assured to be bigger than STDERR_FILENO. This is necessary
@@ -267,9 +577,11 @@ static bool setup_safe_mode(struct inittab_entry *entry)
 		    "Could not fork safe mode placeholder process: %m\n");
 		goto error_fork;
 	} else if (p->pid > 0) {
-		p->config = entry;
-		p->next = running_processes;
-		running_processes = p;
+		if (!add_process(p, entry)) {
+			/* Untracked placeholder is of no use */
+			kill(p->pid, SIGKILL);
+			goto error_fork;
+		}
 
 		(void)close(pipefd[0]); /* pid1 won't read from it */
 		safe_mode_pipe_fd = pipefd[1];
@@ -314,7 +626,8 @@ static void setup_signals(sigset_t *mask)
 	    SIGCHLD, /* To monitor started processes */
 	    SIGTERM, /* Reboot signal */
 	    SIGUSR1, /* Halt signal */
-	    SIGUSR2  /* Shutdown signal */
+	    SIGUSR2, /* Shutdown signal */
+	    SIGHUP   /* Dump statistics signal */
 	};
 
 	r = sigemptyset(mask);
@@ -329,617 +642,1025 @@ static void setup_signals(sigset_t *mask)
 	assert(r == 0);
 }
 
-/* Try to open the /dev/console, the maximum attempts is 10 times with
- * 100000 microseconds between each attempt
+/* Expects SIGCHLD to be disabled when called */
+static pid_t spawn_exec(const struct inittab_entry *entry)
+{
+	struct spawn_attr attr;
+	pid_t p;
+
+	if (!spawn_attr_init(&attr, &entry->cmd, entry->exec_path,
+			     entry->ctty_path, &entry->cpus)) {
+		return -1;
+	}
+
+	spawn_attr_set_sched(&attr, &entry->sched);
+	spawn_attr_set_ioprio(&attr, &entry->ioprio);
+	spawn_attr_set_mempolicy(&attr, &entry->mempolicy);
+	spawn_attr_set_rlimits(&attr, entry->rlimits, entry->rlimit_count);
+
+	/* Not fatal, it just runs on init cgroup */
+	if (entry->cgroup[0] != '\0') {
+		(void)spawn_attr_set_cgroup(&attr, entry->cgroup);
+	}
+
+	if (entry->ready_notify && (notify_child_fd() >= 0) &&
+	    !spawn_attr_set_notify(&attr, notify_child_fd())) {
+		spawn_attr_destroy(&attr);
+		return -1;
+	}
+
+	p = spawn(&attr);
+	spawn_attr_destroy(&attr);
+
+	log_message("spawn result for '%s': %d\n", entry->process_name, p);
+	/* the caller is responsible to check the error */
+	return p;
+}
+
+static void start_safe_mode(const char *process_name, int signal)
+{
+	bool r;
+	struct process *p;
+
+	p = process_table_first(&running_processes, PROCESS_KIND_SAFE_MODE);
+
+	if (p == NULL) {
+		/* No safe mode process, let's panic the kernel */
+		panic("Safe mode required, but safe mode process "
+		      "placeholder not found!\n");
+	}
+	r = execute_safe_mode(safe_mode_pipe_fd, process_name, signal);
+	if (!r) {
+		panic("Couldn't start safe mode!");
+	}
+	/* This will not return to false once is set.
+	 It is expected that init will exit after. If that's not the
+	 case, this approach must be redefined. */
+	safe_mode_on = true;
+}
+
+/* Processes requested are counted already, as spawn server may only tell
+ * their pids later */
+static void entry_process_added(const struct inittab_entry *entry)
+{
+	if (entry->state != NULL) {
+		entry->state->running++;
+	}
+}
+
+/* Waited entries are so from the moment they are requested, as spawn server
+ * may only tell their pids later */
+static void start_batch(const struct inittab_entry *const *entries,
+			size_t count)
+{
+	bool by_server;
+	size_t i;
+
+	by_server = spawn_server_request(entries, count);
+
+	for (i = 0; i < count; i++) {
+		entry_process_added(entries[i]);
+
+		if (is_waited_entry(entries[i])) {
+			remaining.pending_finish++;
+			log_message("Pending increased to %d\n",
+				    remaining.pending_finish);
+		}
+
+		if (!by_server) {
+			process_spawned(entries[i], spawn_exec(entries[i]));
+		}
+	}
+}
+
+static void queue_ready_entry(struct inittab_entry *entry)
+{
+	entry->next_ready = NULL;
+	*remaining.ready_tail = entry;
+	remaining.ready_tail = &entry->next_ready;
+}
+
+/* Ready entries are started together, so spawn server gets them as one
+ * batch */
+static void start_ready_entries(void)
+{
+	const struct inittab_entry *batch[SPAWN_BATCH_MAX];
+	size_t count = 0;
+
+	while (remaining.ready != NULL) {
+		struct inittab_entry *entry = remaining.ready;
+
+		/* Spawning a full batch may queue more entries */
+		remaining.ready = entry->next_ready;
+		if (remaining.ready == NULL) {
+			remaining.ready_tail = &remaining.ready;
+		}
+
+		batch[count++] = entry;
+		if (count == ARRAY_SIZE(batch)) {
+			start_batch(batch, count);
+			count = 0;
+		}
+	}
+	remaining.ready_tail = &remaining.ready;
+
+	if (count > 0) {
+		start_batch(batch, count);
+	}
+}
+
+/* Entries of list other than the one being started are of no concern */
+static bool is_starting_entry(const struct inittab_entry *entry)
+{
+	return ((current_stage == STAGE_STARTUP) && is_startup_entry(entry)) ||
+	       ((current_stage == STAGE_SHUTDOWN) && is_shutdown_entry(entry));
+}
+
+static void entry_finished(const struct inittab_entry *entry)
+{
+	size_t i;
+
+	if (!is_starting_entry(entry)) {
+		return;
+	}
+
+	remaining.unfinished--;
+
+	for (i = 0; i < entry->before_count; i++) {
+		struct inittab_entry *next = entry->before[i];
+
+		if (--next->waiting == 0) {
+			queue_ready_entry(next);
+		}
+	}
+}
+
+static void start_processes(struct inittab_entry *list)
+{
+	struct inittab_entry *entry;
+
+	remaining.ready = NULL;
+	remaining.ready_tail = &remaining.ready;
+	remaining.unfinished = 0;
+	remaining.pending_finish = 0;
+
+	for (entry = list; entry != NULL; entry = entry->next) {
+		entry->waiting = entry->after_count;
+		remaining.unfinished++;
+
+		if (entry->waiting == 0) {
+			queue_ready_entry(entry);
+		}
+	}
+
+	start_ready_entries();
+}
+
+/* Sends `signal` to running processes of `entry`, which must have a state */
+static void signal_entry_processes(const struct inittab_entry *entry,
+				   int signal)
+{
+	struct process *p;
+
+	assert(entry->state != NULL);
+
+	for (p = entry->state->processes; p != NULL; p = p->entry_next) {
+		log_message("Sending signal %d to %d (%s)\n", signal, p->pid,
+			    entry->process_name);
+		signal_process(p, signal);
+	}
+}
+
+static enum timeout_result stop_timeout_cb(void *data)
+{
+	struct entry_state *state = data;
+
+	/* Freed by mainloop once we return */
+	state->kill_timeout = NULL;
+
+	log_message("'%s' did not stop in %" PRIu32 " ms, killing it\n",
+		    state->entry->process_name, state->entry->stop_timeout_ms);
+	timeline_record(TIMELINE_STOP, state->entry->process_name, 0, SIGKILL);
+	signal_entry_processes(state->entry, SIGKILL);
+
+	return TIMEOUT_STOP;
+}
+
+/* Entries it comes after can be stopped once all coming after them are */
+static void release_stop_dependencies(const struct inittab_entry *entry)
+{
+	size_t i;
+
+	for (i = 0; i < entry->after_count; i++) {
+		struct inittab_entry *dependency = entry->after[i];
+
+		if (--dependency->state->stop_waiting == 0) {
+			queue_ready_entry(dependency);
+		}
+	}
+}
+
+static void stop_entry(struct inittab_entry *entry)
+{
+	struct entry_state *state = entry->state;
+
+	state->stopping = true;
+
+	if (state->running == 0U) {
+		release_stop_dependencies(entry);
+		return;
+	}
+
+	log_message("Stopping '%s'\n", entry->process_name);
+	timeline_record(TIMELINE_STOP, entry->process_name, 0,
+			entry->stop_signal);
+	state->stop_start_ms = elapsed_ms();
+	signal_entry_processes(entry, entry->stop_signal);
+
+	/* Processes still being spawned get the signal once tracked */
+	state->kill_timeout = mainloop_add_data_timeout(
+	    entry->stop_timeout_ms, stop_timeout_cb, state);
+	if (state->kill_timeout == NULL) {
+		log_message("Init won't be able to kill '%s' if it doesn't "
+			    "stop\n",
+			    entry->process_name);
+	}
+}
+
+/* Entries ready to be stopped are queued just like ready to start ones */
+static void stop_ready_entries(void)
+{
+	while (remaining.ready != NULL) {
+		struct inittab_entry *entry = remaining.ready;
+
+		/* Stopping it may queue more entries */
+		remaining.ready = entry->next_ready;
+		if (remaining.ready == NULL) {
+			remaining.ready_tail = &remaining.ready;
+		}
+
+		stop_entry(entry);
+	}
+}
+
+/* Startup graph is walked in reverse, so an entry is stopped after all
+ * entries that come after it, and independent ones are stopped together */
+static void start_termination(struct inittab_entry *list)
+{
+	struct inittab_entry *entry;
+
+	for (entry = list; entry != NULL; entry = entry->next) {
+		entry->state->stop_waiting = entry->before_count;
+
+		if (entry->state->stop_waiting == 0) {
+			queue_ready_entry(entry);
+		}
+	}
+
+	stop_ready_entries();
+}
+
+/* Called once each process of `entry`, requested or running, is gone */
+static void entry_process_gone(const struct inittab_entry *entry)
+{
+	struct entry_state *state = entry->state;
+
+	if (state == NULL) {
+		return;
+	}
+
+	state->running--;
+
+	if (!state->stopping || (state->running > 0U)) {
+		return;
+	}
+
+	if (state->kill_timeout != NULL) {
+		mainloop_remove_timeout(state->kill_timeout);
+		state->kill_timeout = NULL;
+	}
+
+	log_message("'%s' stopped in %" PRIu64 " ms\n", entry->process_name,
+		    elapsed_ms() - state->stop_start_ms);
+	release_stop_dependencies(entry);
+}
+
+/* Run after mainloop iterations that changed init state. Ensures that init
+ * is on correct 'stage' - and perform actions of that stage
  */
-static int open_console(const char *terminal, int mode)
+static void stage_maintenance(void)
 {
-	int times = 10;
-	int tty = -1;
+	switch (current_stage) {
+	case STAGE_STARTUP:
+	case STAGE_SHUTDOWN:
+		start_ready_entries();
+
+		if (remaining.unfinished == 0U) {
+			/* No more process to start, decide on what next */
+			if (current_stage == STAGE_STARTUP) {
+				log_message("Startup finished in %" PRIu64
+					    " ms\n",
+					    elapsed_ms());
+				set_stage(STAGE_RUN);
+				/* We can rest until signal to terminate */
+				mainloop_set_post_iteration_callback(NULL);
+				/* Startup is done, no hurry anymore */
+				if (!mainloop_defer(dump_timeline, NULL)) {
+					dump_timeline(NULL);
+				}
+			} else {
+				set_stage(STAGE_CLOSE);
+			}
 
-	for (; times > 0; times--) {
-		struct timespec pause = {};
+			/* Stage changed, so state must be evaluated again */
+			mainloop_request_post_iteration();
+		}
+		break;
+	case STAGE_TERMINATION:
+		stop_ready_entries();
 
-		errno = 0;
-		tty = open(terminal, mode);
-		if (tty >= 0) {
-			break;
+		/* If all process finished, time to start 'shutdown' ones.
+		 * Note that safe_mode process (safe_mode on or not)
+		 * will not be terminated/killed, unless it run and exited */
+		if ((process_table_count(&running_processes,
+					 PROCESS_KIND_ONE_SHOT) == 0) &&
+		    (process_table_count(&running_processes,
+					 PROCESS_KIND_SERVICE) == 0) &&
+		    !spawn_server_busy()) {
+			log_message("Termination finished in %" PRIu64 " ms\n",
+				    elapsed_ms() - shutdown_start_ms);
+
+			if (inittab_entries.shutdown_list != NULL) {
+				set_stage(STAGE_SHUTDOWN);
+				start_processes(inittab_entries.shutdown_list);
+			} else {
+				/* Nothing to run on shutdown. Init is closing
+				 */
+				set_stage(STAGE_CLOSE);
+			}
+
+			mainloop_request_post_iteration();
 		}
+		break;
+	default:
+		/* Nothing */
+		break;
+	}
 
-		if (errno != EIO) {
-			break;
+	/* Init is closing, abandon the loop */
+	if (current_stage == STAGE_CLOSE) {
+		log_message("Shutdown finished in %" PRIu64 " ms\n",
+			    elapsed_ms() - shutdown_start_ms);
+		mainloop_exit();
+	}
+}
+
+static void track_process(const struct inittab_entry *entry, pid_t pid,
+			  uint32_t attempt, bool restarted);
+
+static bool setup_entry_states(struct inittab_entry *list)
+{
+	struct inittab_entry *entry;
+
+	for (entry = list; entry != NULL; entry = entry->next) {
+		entry->state = calloc(1, sizeof(struct entry_state));
+		if (entry->state == NULL) {
+			log_message("Could not allocate state of '%s': %m\n",
+				    entry->process_name);
+			return false;
 		}
+		entry->state->entry = entry;
+	}
+
+	return true;
+}
 
-		/* Isn't this a really, really long time? */
-		pause.tv_nsec = 100 * 1000 * 1000; // 100 msecs
-		(void)nanosleep(&pause, NULL);
+static void cancel_restarts(struct inittab_entry *list)
+{
+	struct inittab_entry *entry;
+
+	for (entry = list; entry != NULL; entry = entry->next) {
+		struct entry_state *state = entry->state;
+
+		if ((state != NULL) && (state->restart_timeout != NULL)) {
+			mainloop_remove_timeout(state->restart_timeout);
+			state->restart_timeout = NULL;
+		}
+	}
+}
+
+static void free_entry_states(struct inittab_entry *list)
+{
+	struct inittab_entry *entry;
+
+	cancel_restarts(list);
+
+	for (entry = list; entry != NULL; entry = entry->next) {
+		if (entry->state == NULL) {
+			continue;
+		}
+
+		if (entry->state->kill_timeout != NULL) {
+			mainloop_remove_timeout(entry->state->kill_timeout);
+		}
+
+		/* Processes may outlive it */
+		while (entry->state->processes != NULL) {
+			unlink_entry_process(entry->state->processes);
+		}
+		free(entry->state);
+		entry->state = NULL;
 	}
-
-	return tty;
 }
 
-static bool reset_console(int fd)
+static enum timeout_result restart_cb(void *data)
 {
-	int r;
-	struct termios tty;
-	bool result = false;
+	struct entry_state *state = data;
+	const struct inittab_entry *entry = state->entry;
 
-	r = tcgetattr(fd, &tty);
-	if (r == -1) {
-		goto end;
-	}
+	/* Freed by mainloop once we return */
+	state->restart_timeout = NULL;
 
-	/* TODO assess what is really relevant to our case */
-	tty.c_cflag &= CBAUD | CBAUDEX | CSIZE | CSTOPB | PARENB | PARODD;
-	tty.c_cflag |= HUPCL | CLOCAL | CREAD;
-	tty.c_iflag = IGNPAR | ICRNL | IXON | IXANY;
-	tty.c_oflag = OPOST | ONLCR;
-	tty.c_lflag = ISIG | ICANON | ECHO | ECHOCTL | ECHOPRT | ECHOKE;
-
-	tty.c_cc[VINTR] = CINTR;   /* ^C */
-	tty.c_cc[VQUIT] = CQUIT;   /* ^\ */
-	tty.c_cc[VERASE] = CERASE; /* ASCII DEL (0177) */
-	tty.c_cc[VKILL] = CKILL;   /* ^X */
-	tty.c_cc[VEOF] = CEOF;     /* ^D */
-	tty.c_cc[VTIME] = 0;
-	tty.c_cc[VMIN] = 1;
-	tty.c_cc[VSTART] = CSTART; /* ^Q */
-	tty.c_cc[VSTOP] = CSTOP;   /* ^S */
-	tty.c_cc[VSUSP] = CSUSP;   /* ^Z */
-	tty.c_cc[VEOL] = _POSIX_VDISABLE;
-	tty.c_cc[VREPRINT] = CREPRINT; /* ^R */
-	tty.c_cc[VWERASE] = CWERASE;   /* ^W */
-	tty.c_cc[VLNEXT] = CLNEXT;     /* ^V */
-	tty.c_cc[VEOL2] = _POSIX_VDISABLE;
-
-	/*
-	 * Now set the terminal line.
-	 * We don't care about non-transmitted output data
-	 * and non-read input data.
-	 */
-	r = tcsetattr(fd, TCSANOW, &tty);
-	if (r == -1) {
-		goto end;
+	if (((current_stage != STAGE_STARTUP) && (current_stage != STAGE_RUN)) ||
+	    safe_mode_on) {
+		return TIMEOUT_STOP;
 	}
 
-	r = tcflush(fd, TCIOFLUSH);
-	if (r == -1) {
-		goto end;
-	}
+	state->restarts++;
+	log_message("Restarting '%s', restart %" PRIu32 "\n",
+		    entry->process_name, state->restarts);
 
-	/* Everything went OK */
-	result = true;
+	/* Not part of any batch, so not worth a spawn server request */
+	entry_process_added(entry);
+	track_process(entry, spawn_exec(entry), 0, true);
 
-end:
-	return result;
+	return TIMEOUT_STOP;
 }
 
-static bool setup_stty(const char *terminal)
+/* Backoff doubles the delay on each restart, plus up to a quarter of it at
+ * random, so services failing together don't restart in lockstep */
+static uint32_t restart_delay(const struct inittab_entry *entry,
+			      uint32_t backoff)
 {
-	int r, tty;
+	uint64_t delay = entry->restart_delay_ms;
 
-	tty = open_console(terminal, O_RDWR | O_NOCTTY | O_CLOEXEC);
-	if (tty == -1) {
-		log_message("Could not open terminal for child process\n");
-		goto err_open;
+	while ((backoff-- > 0U) && (delay < RESTART_DELAY_MAX)) {
+		delay *= 2U;
 	}
 
-	if (!safe_dup(&tty)) {
-		goto err_dup_in;
+	if (delay > RESTART_DELAY_MAX) {
+		delay = RESTART_DELAY_MAX;
 	}
 
-	r = dup2(tty, STDIN_FILENO);
-	if (r == -1) {
-		log_message("Could not dup terminal for STDIN: %m\n");
-		goto err_dup_in;
+	delay += (uint64_t)random() % (delay / 4U + 1U);
+
+	return (uint32_t)delay;
+}
+
+static void schedule_restart(struct entry_state *state)
+{
+	const struct inittab_entry *entry = state->entry;
+	uint64_t now = elapsed_ms();
+	uint32_t delay;
+
+	if (((current_stage != STAGE_STARTUP) && (current_stage != STAGE_RUN)) ||
+	    safe_mode_on || (state->restart_timeout != NULL)) {
+		return;
 	}
 
-	r = dup2(tty, STDOUT_FILENO);
-	if (r == -1) {
-		log_message("Could not dup terminal for STDOUT: %m\n");
-		goto err_dup_out;
+	/* Ran for a whole window, so it's not crash looping */
+	if (now - state->started_ms >= entry->restart_window_ms) {
+		state->backoff = 0;
 	}
 
-	r = dup2(tty, STDERR_FILENO);
-	if (r == -1) {
-		log_message("Could not dup terminal for STDERR: %m\n");
-		goto err_dup_errno;
+	if (now - state->window_start_ms >= entry->restart_window_ms) {
+		state->window_start_ms = now;
+		state->window_restarts = 0;
 	}
 
-	if (!reset_console(tty)) {
-		goto err_console;
+	if (state->window_restarts >= entry->restart_limit) {
+		log_message("Service '%s' restarted %" PRIu32
+			    " times in %" PRIu32 " ms, giving up\n",
+			    entry->process_name, state->window_restarts,
+			    entry->restart_window_ms);
+		state->gave_up = true;
+		return;
 	}
 
-	(void)close(tty);
+	delay = restart_delay(entry, state->backoff);
+	state->backoff++;
+	state->window_restarts++;
 
-	return true;
+	state->restart_timeout =
+	    mainloop_add_data_timeout(delay, restart_cb, state);
+	if (state->restart_timeout == NULL) {
+		log_message("Could not schedule restart of '%s'\n",
+			    entry->process_name);
+		return;
+	}
 
-err_console:
-	(void)close(STDERR_FILENO);
-err_dup_errno:
-	(void)close(STDOUT_FILENO);
-err_dup_out:
-	(void)close(STDIN_FILENO);
-err_dup_in:
-	(void)close(tty);
-err_open:
-	return false;
+	log_message("Service '%s' will be restarted in %" PRIu32 " ms\n",
+		    entry->process_name, delay);
 }
 
-static void setup_child(const char *command, const char *console,
-			int32_t core_id)
+static void service_exited(struct entry_state *state, const siginfo_t *info,
+			   bool abnormal)
 {
-	int r;
-	pid_t p;
-	sigset_t mask;
-	struct cmdline_contents cmd_contents = {};
+	state->last_code = info->si_code;
+	state->last_status = info->si_status;
 
-	r = sigemptyset(&mask);
-	assert(r == 0);
+	if ((state->entry->restart == RESTART_ALWAYS) ||
+	    ((state->entry->restart == RESTART_ON_FAILURE) && abnormal)) {
+		schedule_restart(state);
+	}
+}
 
-	r = sigprocmask(SIG_SETMASK, &mask, NULL);
-	assert(r == 0);
+static void handle_shutdown_cmd(struct signalfd_siginfo *info, int command)
+{
+	(void)info; /* Not used */
 
-	/* TODO check if this can be here (child process) or should be done on
-	 * pid 1 */
-	if (!parse_cmdline(command, &cmd_contents)) {
-		goto end;
-	}
+	shutdown_command = command;
 
-	/* Become a session leader */
-	p = setsid();
-	if (p == -1) {
-		goto end;
+	/* Already going down, it will end with the latest command */
+	if (current_stage >= STAGE_TERMINATION) {
+		return;
 	}
 
-	/* Set CPU affinity if defined on inittab */
-	if (core_id >= 0) {
-		cpu_set_t set;
+	/* Ensure 'remaining list' is cleaned up */
+	remaining.ready = NULL;
+	remaining.ready_tail = &remaining.ready;
+	remaining.unfinished = 0;
+	remaining.pending_finish = 0;
 
-		CPU_ZERO(&set);
-		CPU_SET(core_id, &set);
+	/* Services going down now are not coming back */
+	cancel_restarts(inittab_entries.startup_list);
 
-		errno = 0;
-		if (sched_setaffinity(0, sizeof(set), &set) == -1) {
-			log_message(
-			    "Could not set CPU affinity for process '%s': %m\n",
-			    command);
-			goto end;
-		}
-	}
+	/* We wait for all running process to exit before starting shutdown ones
+	 */
+	set_stage(STAGE_TERMINATION);
+	shutdown_start_ms = elapsed_ms();
+	start_termination(inittab_entries.startup_list);
 
-	/* Configure terminal for child */
-	if (console[0] != '\0') {
-		if (!setup_stty(console)) {
-			log_message(
-			    "Could not setup tty '%s' for process '%s'\n",
-			    console, command);
-			goto end;
-		}
+	/* Stages will change again, let's keep track */
+	mainloop_set_post_iteration_callback(stage_maintenance);
+}
 
-		/* Give a controlling terminal for the process */
-		r = ioctl(STDIN_FILENO, TIOCSCTTY, 0);
-		if (r == -1) {
-			log_message(
-			    "Could not handle controlling terminal: %m\n");
-			goto end;
-		}
-	} else {
-		if (!setup_stdio()) {
-			goto end;
-		}
+/* A one-shot entry exited, or a service notified readiness - or won't */
+static void waited_entry_finished(const struct inittab_entry *entry)
+{
+	if (is_waited_entry(entry) && is_starting_entry(entry)) {
+		remaining.pending_finish--;
+		log_message("Pending decreased to %d\n",
+			    remaining.pending_finish);
+		entry_finished(entry);
 	}
+}
 
-	run_exec(&cmd_contents);
-
-end:
-	free_cmdline_contents(&cmd_contents);
-	return;
+static void process_finished_pending(struct process *p)
+{
+	if (p->pending) {
+		p->pending = false;
+		waited_entry_finished(p->config);
+	}
 }
 
-/* Expects SIGCHLD to be disabled when called */
-static pid_t spawn_exec(const char *command, const char *console,
-			int32_t core_id)
+static enum timeout_result deadline_cb(void *data)
 {
-	pid_t p;
+	struct process *p = data;
+	const struct inittab_entry *config = p->config;
 
-	p = fork();
+	/* Freed by mainloop once we return */
+	p->deadline = NULL;
 
-	log_message("fork result for '%s': %d\n", command, p);
-	/* the caller is responsible to check the error */
-	if (p != 0) {
-		return p;
+	if (!p->pending || !is_starting_entry(config)) {
+		return TIMEOUT_STOP;
 	}
 
-	/* child code, should never return */
-	setup_child(command, console, core_id);
-
-#ifdef COMPILING_COVERAGE
-	__gcov_flush();
-	sync();
-#endif
+	if (config->on_timeout == DEADLINE_WARN) {
+		log_message("Process [%d] (%s) is taking longer than expected "
+			    "to start\n",
+			    p->pid, config->process_name);
+		return TIMEOUT_STOP;
+	}
 
-	/* If returned, we have a lost process */
-	_exit(1);
-}
+	log_message("Process [%d] (%s) missed its start deadline\n", p->pid,
+		    config->process_name);
 
-static enum timeout_result one_shot_timeout_cb(void)
-{
-	if (remaining.pending_finish > 0U) {
-		log_message("Some process are taking longer than expected to "
-			    "complete\n");
-		/* TODO what to do? */
+	if (config->on_timeout == DEADLINE_PROCEED) {
+		process_finished_pending(p);
+		mainloop_request_post_iteration();
+	} else {
+		/* Whatever else is done once it's gone */
+		p->deadline_killed = true;
+		signal_process(p, SIGKILL);
 	}
 
-	one_shot_timeout = NULL;
 	return TIMEOUT_STOP;
 }
 
-static struct process *find_safe_mode_process(void)
+static void watch_deadline(struct process *p)
 {
-	struct process *p = running_processes;
-	while (p != NULL) {
-		if (p->config->type == SAFE_MODE) {
-			break;
-		}
-		p = p->next;
+	uint32_t timeout = p->config->timeout_ms;
+
+	if (timeout == 0U) {
+		timeout = TIMEOUT_ONE_SHOT;
 	}
 
-	return p;
+	p->deadline = mainloop_add_data_timeout(timeout, deadline_cb, p);
+	if (p->deadline == NULL) {
+		log_message("Init won't be able to watch process %d start "
+			    "time\n",
+			    p->pid);
+	}
 }
 
-static void start_safe_mode(const char *process_name, int signal)
+/* Process is gone, `info` comes from waitid() that reaped it */
+static void process_exited(struct process *p, const siginfo_t *info)
 {
-	bool r;
-	struct process *p;
+	const struct inittab_entry *config = p->config;
+	bool abnormal = (info->si_code != CLD_EXITED) || (info->si_status != 0);
+	bool deadline_killed = p->deadline_killed, retry = false;
+	uint32_t attempt = p->attempt;
+	int signal = 0;
+
+	if ((info->si_code == CLD_KILLED) || (info->si_code == CLD_DUMPED)) {
+		signal = info->si_status;
+	}
 
-	p = find_safe_mode_process();
+	timeline_record(TIMELINE_EXIT, config->process_name, p->pid,
+			(signal != 0) ? -signal : info->si_status);
 
-	if (p == NULL) {
-		/* No safe mode process, let's panic the kernel */
-		panic("Safe mode required, but safe mode process "
-		      "placeholder not found!\n");
+	log_message("reaping [%d] (%s)'\n", p->pid, config->process_name);
+
+	if (p->pending && config->ready_notify && !deadline_killed) {
+		log_message("Process [%d] (%s) exited before being ready\n",
+			    p->pid, config->process_name);
 	}
-	r = execute_safe_mode(safe_mode_pipe_fd, process_name, signal);
-	if (!r) {
-		panic("Couldn't start safe mode!");
+
+	/* Entry retried is still pending, on its new process */
+	if (deadline_killed && (config->on_timeout == DEADLINE_RETRY) &&
+	    (attempt < config->retries) && is_starting_entry(config)) {
+		retry = true;
+	} else {
+		/* One shot process terminated decrement counter to start
+		 * remaining_processes*/
+		process_finished_pending(p);
 	}
-	/* This will not return to false once is set.
-	 It is expected that init will exit after. If that's not the
-	 case, this approach must be redefined. */
-	safe_mode_on = true;
-}
 
-static bool start_processes(struct inittab_entry *list)
-{
-	int32_t current_order;
-	bool result = true, has_one_shot = false;
+	/* Process exited, remove from our running process list */
+	remove_process(p);
+	entry_process_gone(config);
 
-	if (list != NULL) {
-		struct inittab_entry *entry;
+	/* Init state only needs to be evaluated if one of its processes
+	 * exited */
+	mainloop_request_post_iteration();
 
-		remaining.pending_finish = 0;
-		entry = list;
-		current_order = entry->order;
+	if (retry) {
+		log_message("Retrying '%s', %" PRIu32 " of %" PRIu32 "\n",
+			    config->process_name, attempt + 1,
+			    config->retries);
+		/* Rare enough to not be worth a spawn server request */
+		entry_process_added(config);
+		track_process(config, spawn_exec(config), attempt + 1, false);
+		return;
+	}
 
-		while ((entry != NULL) && (entry->order == current_order)) {
-			struct process *p;
+	/* Killed by init for missing its deadline, it's not coming back */
+	if ((config->restart != RESTART_NEVER) && !deadline_killed) {
+		service_exited(config->state, info, abnormal);
+	}
 
-			/* First, let's see if we have memory for anciliary
-			 * struct */
-			p = calloc(1, sizeof(struct process));
-			if (p == NULL) {
-				log_message("Could not fork process: %m\n");
-				result = false;
-				break;
+	/* Killed by init, this is not a crash */
+	if (deadline_killed) {
+		if (config->on_timeout == DEADLINE_KILL_AND_SAFE_MODE) {
+			start_safe_mode(config->process_name, signal);
+		}
+	} else if (is_safe_entry(config) && abnormal) {
+		/* A safe process crash - or exitcode != 0 - asks for
+		 * safe_mode */
+		log_message("Abnormal termination of safe process [%d] (%s)\n",
+			    info->si_pid, config->process_name);
+
+		if (config->type == SAFE_MODE) {
+			/* Safe mode process is dead. Have we started safe mode
+			 * or is still just the placeholder process? If the
+			 * first, all we can do is panic. For the later, we'll
+			 * just try to restart it. */
+			if (safe_mode_on) {
+				panic("Safe mode process crashed!\n");
 			}
-			p->pid = spawn_exec(entry->process_name,
-					    entry->ctty_path, entry->core_id);
-
-			if (p->pid > 0) {
-				/* Stores inittab entry information on process
-				 * struct */
-				p->config = entry;
-
-				if (is_one_shot_entry(p->config)) {
-					remaining.pending_finish++;
-					log_message("Pending increased to %d\n",
-						    remaining.pending_finish);
-					has_one_shot = true;
-				}
 
-				p->next = running_processes;
-				running_processes = p;
-			} else {
-				log_message("Could not fork process!\n");
-				if (is_safe_entry(entry)) {
-					/* TODO check if sending -1 makes sense.
-					 * That parameter should be signal (or
-					 * exit code) of crashed process. But
-					 * here, it just failed to fork... */
-					start_safe_mode(entry->process_name,
-							-1);
-				}
-				free(p);
+			if (!setup_safe_mode(inittab_entries.safe_mode_entry)) {
+				panic("Can't keep normal execution without safe "
+				      "mode placeholder process\n");
 			}
+		} else {
+			start_safe_mode(config->process_name, signal);
+		}
+	}
+}
 
-			entry = entry->next;
+/* Tracks a process spawned for `entry`, either by init or by spawn server.
+ * If it's a waited entry, it's already accounted as pending - unless it's
+ * `restarted`, which is no longer part of starting its list */
+static void track_process(const struct inittab_entry *entry, pid_t pid,
+			  uint32_t attempt, bool restarted)
+{
+	struct process *p;
+	siginfo_t info;
 
-			/* If next entry is on next order, but no one-shot entry
-			 * was started in this order, let's simply start next
-			 * order */
-			if ((entry != NULL) &&
-			    (entry->order != current_order) && !has_one_shot) {
-				current_order = entry->order;
-			}
-		}
+	/* Init state will need to be evaluated */
+	mainloop_request_post_iteration();
 
-		remaining.remaining = entry;
+	/* A service is done starting once spawned - or ready, if it notifies
+	 * so - a one-shot once it exits */
+	if (!is_waited_entry(entry) && !restarted) {
+		entry_finished(entry);
 	}
 
-	if (has_one_shot) {
-		one_shot_timeout =
-		    mainloop_add_timeout(TIMEOUT_ONE_SHOT, one_shot_timeout_cb);
-		if (one_shot_timeout == NULL) {
-			/* TODO We couldn't add a timeout to watch over one_shot
-			 * process startup time. How bad is that? */
-			log_message("Init won't be able to watch one-shot "
-				    "process startup time\n");
+	timeline_record(TIMELINE_SPAWN, entry->process_name,
+			(pid > 0) ? pid : -1, 0);
+
+	if (pid <= 0) {
+		log_message("Could not fork process!\n");
+		entry_process_gone(entry);
+		if (restarted) {
+			/* Counts as another crash */
+			schedule_restart(entry->state);
+			return;
+		}
+		waited_entry_finished(entry);
+		if (is_safe_entry(entry)) {
+			/* TODO check if sending -1 makes sense. That parameter
+			 * should be signal (or exit code) of crashed process.
+			 * But here, it just failed to fork... */
+			start_safe_mode(entry->process_name, -1);
 		}
+		return;
 	}
 
-	return result;
-}
-
-/* Run after each mainloop iteration. Ensures that init
- * is on correct 'stage' - and perform actions of that stage
- */
-static void stage_maintenance(void)
-{
-	switch (current_stage) {
-	case STAGE_STARTUP:
-	case STAGE_SHUTDOWN:
-		if (remaining.pending_finish == 0U) {
-			if (one_shot_timeout != NULL) {
-				mainloop_remove_timeout(one_shot_timeout);
-				one_shot_timeout = NULL;
-			}
-
-			if (remaining.remaining != NULL) {
-				start_processes(remaining.remaining);
-			} else {
-				/* No more process to start, decide on what
-				 * next*/
-				if (current_stage == STAGE_STARTUP) {
-					current_stage = STAGE_RUN;
-					/* We can rest until signal to terminate
-					 */
-					mainloop_set_post_iteration_callback(
-					    NULL);
-				} else {
-					current_stage = STAGE_CLOSE;
-				}
-			}
+	p = calloc(1, sizeof(struct process));
+	if (p == NULL) {
+		log_message("Could not track process %d (%s): %m\n", pid,
+			    entry->process_name);
+		entry_process_gone(entry);
+		waited_entry_finished(entry);
+		return;
+	}
+	p->pid = pid;
+
+	/* Stores inittab entry information on process struct. If it can't be
+	 * tracked, it will be reaped as an unknown process, so don't wait for
+	 * it */
+	if (!add_process(p, entry)) {
+		free(p);
+		entry_process_gone(entry);
+		waited_entry_finished(entry);
+		return;
+	}
+
+	p->attempt = attempt;
+	p->pending = is_waited_entry(entry) && !restarted;
+
+	if (entry->state != NULL) {
+		entry->state->started_ms = elapsed_ms();
+	}
+
+	if (entry->ready_notify) {
+		if (take_early_ready(pid)) {
+			timeline_record(TIMELINE_READY, entry->process_name, pid,
+					0);
+			log_message("Process [%d] (%s) is ready\n", pid,
+				    entry->process_name);
+			process_finished_pending(p);
+		} else if (notify_child_fd() < 0) {
+			/* Nothing to notify on, so don't wait for it */
+			process_finished_pending(p);
 		}
-		break;
-	case STAGE_TERMINATION:
-		/* If all process finished, time to start 'shutdown' ones.
-		 * Note that safe_mode process (safe_mode on or not)
-		 * will not be terminated/killed, unless it run and exited */
-		if ((running_processes == NULL) ||
-		    (running_processes->next == NULL)) {
-			if (inittab_entries.shutdown_list != NULL) {
-				current_stage = STAGE_SHUTDOWN;
-				start_processes(inittab_entries.shutdown_list);
-			} else {
-				/* Nothing to run on shutdown. Init is closing
-				 */
-				current_stage = STAGE_CLOSE;
-			}
+	}
 
-			/* Since all processes ended, no need for timer to kill
-			 * them anymore */
-			if (kill_timeout != NULL) {
-				mainloop_remove_timeout(kill_timeout);
-				kill_timeout = NULL;
-			}
-		}
-		break;
-	default:
-		/* Nothing */
-		break;
+	if (p->pending) {
+		watch_deadline(p);
 	}
 
-	/* Init is closing, abandon the loop */
-	if (current_stage == STAGE_CLOSE) {
-		mainloop_exit();
+	if (take_early_exit(pid, &info)) {
+		process_exited(p, &info);
+	} else if ((entry->state != NULL) && entry->state->stopping) {
+		/* Requested before its entry was stopped */
+		signal_process(p, entry->stop_signal);
 	}
 }
 
-static struct process *find_process(pid_t pid)
+static void process_spawned(const struct inittab_entry *entry, pid_t pid)
 {
-	struct process *p = running_processes;
-	while (p != NULL) {
-		if (p->pid == pid) {
-			break;
-		}
-		p = p->next;
-	}
-
-	return p;
+	track_process(entry, pid, 0, false);
 }
 
-static enum timeout_result kill_timeout_cb(void)
+/* Sent by a service on notification socket */
+static void process_ready(pid_t pid)
 {
-	if (current_stage == STAGE_TERMINATION) {
-		struct process *p = running_processes;
+	struct process *p;
 
-		log_message("Sending KILL signal to processes that refused to "
-			    "term in timeout\n");
-		while (p != NULL) {
-			if (p->config->type != SAFE_MODE) {
-				log_message("Sending KILL signal to %d (%s)\n",
-					    p->pid, p->config->process_name);
-				kill(p->pid, SIGKILL);
-			}
-			p = p->next;
+	p = process_table_find(&running_processes, pid);
+	if (p == NULL) {
+		if (spawn_server_busy()) {
+			keep_early_ready(pid);
+		} else {
+			free_early_readies();
+			log_message("Readiness notified by unknown process "
+				    "%d\n",
+				    pid);
 		}
+		return;
 	}
 
-	kill_timeout = NULL;
-	return TIMEOUT_STOP;
-}
+	if (!p->config->ready_notify) {
+		return;
+	}
 
-static void term_running_process(void)
-{
-	struct process *p = running_processes;
-	while (p != NULL) {
-		if (p->config->type != SAFE_MODE) {
-			log_message("Sending TERM signal to %d (%s)\n", p->pid,
-				    p->config->process_name);
-			kill(p->pid, SIGTERM);
-		}
-		p = p->next;
+	timeline_record(TIMELINE_READY, p->config->process_name, pid, 0);
+
+	if (!p->pending) {
+		return;
 	}
 
-	/* Set up a timer to kill any process that refuses to die */
-	kill_timeout = mainloop_add_timeout(TIMEOUT_TERM, kill_timeout_cb);
+	log_message("Process [%d] (%s) is ready\n", pid,
+		    p->config->process_name);
+	process_finished_pending(p);
+	mainloop_request_post_iteration();
 }
 
-static void handle_shutdown_cmd(struct signalfd_siginfo *info, int command)
+/* Returns false if process is still running */
+static bool reap_process(struct process *p)
 {
-	(void)info; /* Not used */
+	siginfo_t info = {};
+	int r;
 
-	/* Ensure 'remaining list' is cleaned up */
-	remaining.remaining = NULL;
-	remaining.pending_finish = 0;
+	errno = 0;
+	if (p->pidfd >= 0) {
+		r = waitid(P_PIDFD, (id_t)p->pidfd, &info, WEXITED | WNOHANG);
+	} else {
+		r = waitid(P_PID, (id_t)p->pid, &info, WEXITED | WNOHANG);
+	}
 
-	/* Cancel any pending one-shot timeout */
-	if (one_shot_timeout != NULL) {
-		mainloop_remove_timeout(one_shot_timeout);
-		one_shot_timeout = NULL;
+	if (r < 0) {
+		log_message("Error on waitid for %d: %m\n", p->pid);
+		/* A safe mode process may have crashed or exit with failure
+		 * and init doesn't have a way to know that if waitid fails.
+		 * What to do? Current approach, panic!*/
+		panic("Won't go anywhere if waitid() is not working!\n");
 	}
 
-	/* We wait for all running process to exit before starting shutdown ones
-	 */
-	/* TODO is this right? */
-	current_stage = STAGE_TERMINATION;
-	term_running_process();
+	if (info.si_pid == 0) {
+		return false;
+	}
 
-	shutdown_command = command;
+	process_exited(p, &info);
 
-	/* Stages will change again, let's keep track */
-	mainloop_set_post_iteration_callback(stage_maintenance);
+	return true;
 }
 
-static void handle_child_exit(struct signalfd_siginfo *info)
+static void process_exit_cb(int fd, uint32_t events, void *data)
 {
-	(void)info;
+	struct process *p = data;
 
-	pid_t pid;
-	struct process *p;
+	(void)fd;
+	(void)events;
+
+	if (!reap_process(p)) {
+		log_message("Spurious exit notification for %d\n", p->pid);
+	}
+}
 
-	struct {
-		const char *process_name;
-		int signal;
-	} deceased_safe_process = {};
+/* Exits of our processes are usually handled by their pidfd watches. This
+ * reaps what is left: processes started without a pidfd, tracked ones whose
+ * pidfd event wasn't dispatched yet and orphans reparented to init */
+static void handle_child_exit(struct signalfd_siginfo *info)
+{
+	(void)info;
 
-	bool start_safe_process = false;
-	bool restart_safe_mode_placeholder = false;
+	if (!spawn_server_busy()) {
+		free_early_exits();
+	}
 
-	/* Reap processes. Multiple SIGCHLD may have been coalesced into one
-	 * signalfd entry */
+	/* Multiple SIGCHLD may have been coalesced into one signalfd entry,
+	 * so peek at every zombie child */
 	while (true) {
-		int wstatus;
+		siginfo_t child = {};
+		struct process *p;
 
 		errno = 0;
-		pid = waitpid(-1, &wstatus, WNOHANG);
-		if (pid <= 0) {
-			if (errno != 0 && errno != ECHILD) {
-				log_message("Error on waitpid: %m\n");
-				/* A safe mode process may have crashed or exit
-				 * with failure and init doesn't have a way to
-				 * know that if waitpid fails What to do?
-				 * Current approach, panic!*/
-				panic("Won't go anywhere if waitpid() is not "
+		if (waitid(P_ALL, 0, &child, WEXITED | WNOHANG | WNOWAIT) < 0) {
+			if (errno != ECHILD) {
+				log_message("Error on waitid: %m\n");
+				panic("Won't go anywhere if waitid() is not "
 				      "working!\n");
 			}
-			log_message("Waitpid result %d - errno %d\n", pid,
-				    errno);
 			break;
 		}
 
-		log_message("child exited: %d\n", pid);
+		if (child.si_pid == 0) {
+			break;
+		}
 
-		/* Get our process info from pid */
-		p = find_process(pid);
-		if (p == NULL) {
-			/* TODO what to do? */
-			log_message("Couldn't find process %d\n", pid);
-			continue;
+		log_message("child exited: %d\n", child.si_pid);
+
+		p = process_table_find(&running_processes, child.si_pid);
+		if (p != NULL) {
+			(void)reap_process(p);
+		} else if (waitid(P_PID, (id_t)child.si_pid, &child,
+				  WEXITED | WNOHANG) < 0) {
+			log_message("Could not reap unknown process %d: %m\n",
+				    child.si_pid);
+			break;
+		} else if (spawn_server_busy()) {
+			keep_early_exit(&child);
+		} else {
+			log_message("Reaped unknown process %d\n",
+				    child.si_pid);
 		}
+	}
+}
 
-		log_message("reaping [%d] (%s)'\n", p->pid,
-			    p->config->process_name);
-		/* A safe process crash - or exitcode != 0 - asks for safe_mode
-		 */
-		if (is_safe_entry(p->config) &&
-		    (!WIFEXITED(wstatus) || (WEXITSTATUS(wstatus) != 0))) {
-			log_message(
-			    "Abnormal termination of safe process [%d] (%s)\n",
-			    p->pid, p->config->process_name);
-
-			if (p->config->type == SAFE_MODE) {
-				/* Safe mode process is dead. Have we started
-				 * safe mode or is still just the placeholder
-				 * process? If the first, all we can do is
-				 * panic. For the later, we'll just try to
-				 * restart it (outside this loop, so we can
-				 * properly reap all dead children). */
-				if (safe_mode_on) {
-					panic("Safe mode process crashed!\n");
-				}
+static const char *entry_state_name(const struct entry_state *state)
+{
+	if (state->gave_up) {
+		return "gave up";
+	} else if (state->running > 0U) {
+		return "running";
+	} else if (state->restart_timeout != NULL) {
+		return "restarting";
+	}
 
-				restart_safe_mode_placeholder = true;
-			} else {
-				start_safe_process = true;
+	return "stopped";
+}
 
-				deceased_safe_process.process_name =
-				    p->config->process_name;
-				if (WIFSIGNALED(wstatus)) {
-					deceased_safe_process.signal =
-					    WTERMSIG(wstatus);
-				}
-			}
+static void dump_restart_stats(int fd)
+{
+	const struct inittab_entry *entry;
+	char last_exit[32];
+
+	for (entry = inittab_entries.startup_list; entry != NULL;
+	     entry = entry->next) {
+		const struct entry_state *state = entry->state;
+
+		if ((state == NULL) || (entry->restart == RESTART_NEVER)) {
+			continue;
 		}
 
-		/* One shot process terminated decrement counter to start
-		 * remaining_processes*/
-		if (is_one_shot_entry(p->config) &&
-		    ((current_stage == STAGE_STARTUP) ||
-		     (current_stage == STAGE_SHUTDOWN))) {
-			remaining.pending_finish--;
-			log_message("Pending decreased to %d\n",
-				    remaining.pending_finish);
+		if (state->last_code == 0) {
+			(void)strcpy(last_exit, "none");
+		} else if (state->last_code == CLD_EXITED) {
+			(void)snprintf(last_exit, sizeof(last_exit),
+				       "status %d", state->last_status);
+		} else {
+			(void)snprintf(last_exit, sizeof(last_exit),
+				       "signal %d", state->last_status);
 		}
 
-		/* Process exited, remove from our running process list */
-		remove_process(&running_processes, p);
+		(void)dprintf(fd,
+			      "Service '%s': %s, %" PRIu32
+			      " restarts, last exit %s\n",
+			      entry->process_name, entry_state_name(state),
+			      state->restarts, last_exit);
 	}
+}
+
+/* Statistics go both to the stats file, replaced on each dump, and to the
+ * log */
+static void dump_stats(void *data)
+{
+	int fd;
+
+	(void)data;
 
-	if (start_safe_process) {
-		start_safe_mode(deceased_safe_process.process_name,
-				deceased_safe_process.signal);
+	errno = 0;
+	fd = open(STATS_FILENAME,
+		  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOCTTY,
+		  S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0) {
+		log_message("Could not open stats file '%s': %m\n",
+			    STATS_FILENAME);
+	} else {
+		mainloop_dump_stats(fd);
+		dump_restart_stats(fd);
+		(void)close(fd);
 	}
 
-	if (restart_safe_mode_placeholder &&
-	    !setup_safe_mode(inittab_entries.safe_mode_entry)) {
-		panic("Can't keep normal execution without safe mode "
-		      "placeholder process\n");
+	if (log_fd() != -1) {
+		mainloop_dump_stats(log_fd());
+		dump_restart_stats(log_fd());
 	}
+
+	dump_timeline(NULL);
+}
+
+static void debug_inittab_deferred(void *data)
+{
+	debug_inittab_entries(data);
 }
 
-static void signal_handler(struct signalfd_siginfo *info)
+static void handle_signal(struct signalfd_siginfo *info)
 {
 	log_message("Received signal - si_signo: %d - ssi_code: %d - ssi_pid: "
 		    "%d - ssi_status %d\n",
@@ -959,12 +1680,40 @@ static void signal_handler(struct signalfd_siginfo *info)
 	case SIGUSR2:
 		handle_shutdown_cmd(info, RB_POWER_OFF);
 		break;
+	case SIGHUP:
+		/* Not urgent, leave it to when there's nothing else to do */
+		if (!mainloop_defer(dump_stats, NULL)) {
+			dump_stats(NULL);
+		}
+		break;
 	default:
 		/* Nothing to do*/
 		break;
 	}
 }
 
+static void signal_handler(struct signalfd_siginfo *info, size_t count)
+{
+	size_t i;
+	bool child_exit = false;
+
+	/* All children are reaped at once, so only once per batch - and
+	 * before other signals, so that shutdown doesn't try to terminate
+	 * processes already gone */
+	for (i = 0; i < count; i++) {
+		if ((info[i].ssi_signo == SIGCHLD) && !child_exit) {
+			handle_signal(&info[i]);
+			child_exit = true;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (info[i].ssi_signo != SIGCHLD) {
+			handle_signal(&info[i]);
+		}
+	}
+}
+
 static void do_reboot(int cmd)
 {
 	/* Umount fs */
@@ -1051,7 +1800,10 @@ int main(int argc, char *argv[])
 	struct mainloop_signal_handler *msh = NULL;
 	int r, result = EXIT_SUCCESS;
 
-	current_stage = STAGE_SETUP;
+	set_stage(STAGE_SETUP);
+	(void)clock_gettime(CLOCK_MONOTONIC, &init_start);
+	/* Only for restart jitter, it needs no good randomness */
+	srandom((unsigned int)init_start.tv_nsec);
 
 	if (getpid() != 1) {
 		result = EXIT_FAILURE;
@@ -1108,8 +1860,8 @@ int main(int argc, char *argv[])
 		goto end;
 	}
 
-	/* Sets handler to be run after each iteration. This handler
-	 * will track init state machine  */
+	/* Sets handler to be run after iterations that change init state. This
+	 * handler will track init state machine  */
 	mainloop_set_post_iteration_callback(stage_maintenance);
 
 	msh = mainloop_add_signal_handler(&mask, signal_handler);
@@ -1120,10 +1872,36 @@ int main(int argc, char *argv[])
 
 	start_watchdog();
 
+	timeline_record(TIMELINE_BEGIN, "inittab", 0, 0);
 	if (!read_inittab(INITTAB_FILENAME, &inittab_entries)) {
 		result = EXIT_FAILURE;
 		goto end;
 	}
+	timeline_record(TIMELINE_END, "inittab", 0, 0);
+
+	/* Listing entries is just for debugging, it can wait */
+	(void)mainloop_defer(debug_inittab_deferred, &inittab_entries);
+
+	if (!setup_entry_states(inittab_entries.startup_list)) {
+		result = EXIT_FAILURE;
+		goto end;
+	}
+
+	cgroup_setup(&inittab_entries);
+
+	if (!process_table_init(&running_processes)) {
+		result = EXIT_FAILURE;
+		goto end;
+	}
+
+	/* Not fatal, services are just not waited for readiness. Before spawn
+	 * server starts, so it has the socket for its children */
+	if (!notify_start(process_ready)) {
+		log_message("Services won't be able to notify readiness\n");
+	}
+
+	/* Not fatal, init can spawn entries itself */
+	(void)spawn_server_start(process_spawned);
 
 	/* Start a placeholder process to be used if we need to go into safe
 	 * mode*/
@@ -1133,13 +1911,22 @@ int main(int argc, char *argv[])
 	}
 
 	/* Start initial list of process */
-	current_stage = STAGE_STARTUP;
+	set_stage(STAGE_STARTUP);
 	start_processes(inittab_entries.startup_list);
 
 	mainloop_start();
 
-	free_process_list(&running_processes);
+	/* While entry names it points to are still around */
+	dump_timeline(NULL);
+
+	spawn_server_stop();
+	notify_stop();
+	free_early_exits();
+	free_early_readies();
+	free_processes();
 
+	cgroup_cleanup(&inittab_entries);
+	free_entry_states(inittab_entries.startup_list);
 	free_inittab_entry_list(inittab_entries.startup_list);
 	free_inittab_entry_list(inittab_entries.shutdown_list);
 	free_inittab_entry_list(inittab_entries.safe_mode_entry);
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef MAINLOOP_BACKEND_HEADER_
+#define MAINLOOP_BACKEND_HEADER_
+
+/* Internal interface between mainloop core and the backends that wait for
+ * events. Not to be used outside mainloop. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "mainloop.h"
+
+/* Biggest read a backend does on behalf of a source */
+#define MAINLOOP_READ_MAX 4096
+
+/* Kind of callback, for statistics */
+enum mainloop_source_type {
+	MAINLOOP_SOURCE_SIGNAL,
+	MAINLOOP_SOURCE_TIMEOUT,
+	MAINLOOP_SOURCE_FD,
+	MAINLOOP_SOURCE_POST_ITERATION,
+	MAINLOOP_SOURCE_IDLE,
+	MAINLOOP_SOURCE_TYPES
+};
+
+/* Every file descriptor registered on a backend has a callback_data, that
+ * knows how to dispatch its events. It must be the first member of the
+ * source struct that contains it, so that freeing it frees the whole source.
+ * Sources removed while a batch of events is being dispatched are only freed
+ * after the batch, as backend or the batch may still reference them.
+ *
+ * If `read_size` is not zero, backend itself reads up to `read_size` bytes
+ * from fd when it is readable, and hands them to `dispatch` (or the error, as
+ * a negative errno on `nread`). Otherwise, `dispatch` receives the
+ * `enum mainloop_fd_event` mask of events that happened. */
+struct callback_data {
+	int fd;
+	bool removed;
+	struct callback_data *next_removed;
+	size_t read_size;
+	bool (*dispatch)(struct callback_data *cb_data, uint32_t events,
+			 const void *buf, ssize_t nread);
+	int32_t backend_slot; /* Backend private */
+	enum mainloop_source_type type;
+	enum mainloop_priority priority;
+};
+
+struct mainloop_backend {
+	const char *name;
+	bool (*setup)(void);
+	void (*close)(void);
+	bool (*add)(struct callback_data *cb_data, uint32_t events);
+	bool (*modify)(struct callback_data *cb_data, uint32_t events);
+	void (*remove)(struct callback_data *cb_data);
+	/* Waits for events - or just collects pending ones, if not `block` -
+	 * and calls mainloop_queue_event() for each of them. Returns false if
+	 * queueing failed */
+	bool (*wait)(bool block);
+};
+
+extern const struct mainloop_backend mainloop_epoll_backend;
+#ifdef MAINLOOP_IO_URING
+extern const struct mainloop_backend mainloop_io_uring_backend;
+#endif
+
+extern struct mainloop_counters mainloop_counters;
+
+/* Must be called by backends as soon as they wake up with new events */
+void mainloop_wakeup(void);
+/* Events are only dispatched after backend wait returns, so `buf` is copied
+ * and can be reused right away */
+bool mainloop_queue_event(struct callback_data *cb_data, uint32_t events,
+			  const void *buf, ssize_t nread);
+
+#endif
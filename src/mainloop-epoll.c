@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2017 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "mainloop-backend.h"
+
+/* Events buffer grows with the number of registered file descriptors, so a
+ * burst on all of them can be drained on a single epoll_wait() */
+#ifndef EVENTS_MIN
+#define EVENTS_MIN 8
+#endif
+
+#ifndef EVENTS_MAX
+#define EVENTS_MAX 1024
+#endif
+
+static int epollfd = -1;
+
+static struct epoll_event min_events[EVENTS_MIN];
+static struct epoll_event *events = min_events;
+static size_t events_size = EVENTS_MIN;
+static size_t registered_fds;
+
+static uint32_t to_epoll_events(uint32_t events)
+{
+	uint32_t result = 0;
+
+	if ((events & MAINLOOP_FD_READ) != 0U) {
+		result |= EPOLLIN;
+	}
+	if ((events & MAINLOOP_FD_WRITE) != 0U) {
+		result |= EPOLLOUT;
+	}
+	if ((events & MAINLOOP_FD_HANGUP) != 0U) {
+		result |= EPOLLRDHUP;
+	}
+	if ((events & MAINLOOP_FD_EDGE) != 0U) {
+		result |= EPOLLET;
+	}
+
+	return result;
+}
+
+static uint32_t from_epoll_events(uint32_t events)
+{
+	uint32_t result = 0;
+
+	if ((events & EPOLLIN) != 0U) {
+		result |= MAINLOOP_FD_READ;
+	}
+	if ((events & EPOLLOUT) != 0U) {
+		result |= MAINLOOP_FD_WRITE;
+	}
+	if ((events & (EPOLLHUP | EPOLLRDHUP)) != 0U) {
+		result |= MAINLOOP_FD_HANGUP;
+	}
+	if ((events & EPOLLERR) != 0U) {
+		result |= MAINLOOP_FD_ERROR;
+	}
+
+	return result;
+}
+
+static bool epoll_setup(void)
+{
+	bool result = true;
+
+	/* We should not have set up before */
+	assert(epollfd == -1);
+
+	epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epollfd == -1) {
+		log_message("Error creating epoll fd: %m\n");
+		result = false;
+	}
+
+	return result;
+}
+
+static void epoll_close(void)
+{
+	(void)close(epollfd);
+	epollfd = -1;
+	registered_fds = 0;
+
+	if (events != min_events) {
+		free(events);
+		events = min_events;
+		events_size = EVENTS_MIN;
+	}
+}
+
+static bool epoll_add(struct callback_data *cb_data, uint32_t events)
+{
+	bool result = true;
+	struct epoll_event epev = {};
+
+	assert(epollfd > -1);
+	assert(cb_data->fd > -1);
+
+	epev.events = to_epoll_events(events);
+	epev.data.ptr = cb_data;
+
+	log_message("Adding %d to %d epoll\n", cb_data->fd, epollfd);
+
+	mainloop_counters.syscalls++;
+	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, cb_data->fd, &epev) < 0) {
+		log_message("Error adding file descriptor to epoll: %m\n");
+		result = false;
+	} else {
+		registered_fds++;
+	}
+
+	return result;
+}
+
+static bool epoll_modify(struct callback_data *cb_data, uint32_t events)
+{
+	bool result = true;
+	struct epoll_event epev = {};
+
+	assert(epollfd > -1);
+
+	epev.events = to_epoll_events(events);
+	epev.data.ptr = cb_data;
+
+	errno = 0;
+	mainloop_counters.syscalls++;
+	if (epoll_ctl(epollfd, EPOLL_CTL_MOD, cb_data->fd, &epev) < 0) {
+		log_message("Could not modify file descriptor on epoll: %m\n");
+		result = false;
+	}
+
+	return result;
+}
+
+static void epoll_remove(struct callback_data *cb_data)
+{
+	if ((cb_data->fd > -1) && (epollfd > -1)) {
+		log_message("Removing %d from %d epoll\n", cb_data->fd,
+			    epollfd);
+
+		errno = 0;
+		mainloop_counters.syscalls++;
+		if (epoll_ctl(epollfd, EPOLL_CTL_DEL, cb_data->fd, NULL) < 0) {
+			log_message("Could not remove file descriptor from "
+				    "epoll: %m\n");
+		} else {
+			registered_fds--;
+		}
+	}
+}
+
+/* Keeps events buffer big enough to hold one event per registered file
+ * descriptor. If it can't grow, mainloop simply keeps going with current
+ * one - remaining events will be caught on next epoll_wait() */
+static void adjust_events_size(void)
+{
+	size_t wanted = registered_fds;
+	struct epoll_event *new_events;
+
+	if (wanted < EVENTS_MIN) {
+		wanted = EVENTS_MIN;
+	} else if (wanted > EVENTS_MAX) {
+		wanted = EVENTS_MAX;
+	} else {
+		/* Nothing to clamp */
+	}
+
+	/* Only shrink if buffer is much bigger than needed, to avoid
+	 * reallocating back and forth */
+	if ((wanted <= events_size) && ((wanted * 4U) > events_size)) {
+		return;
+	}
+
+	if (wanted == EVENTS_MIN) {
+		/* Shrinking back, so current buffer is not `min_events` */
+		free(events);
+		new_events = min_events;
+	} else if (events == min_events) {
+		new_events = calloc(wanted, sizeof(struct epoll_event));
+	} else {
+		new_events = realloc(events, wanted * sizeof(struct epoll_event));
+	}
+
+	if (new_events == NULL) {
+		log_message("Could not resize events buffer to %zu: %m\n",
+			    wanted);
+		return;
+	}
+
+	events = new_events;
+	events_size = wanted;
+}
+
+static bool epoll_wait_events(bool block)
+{
+	int i, r;
+	static char buf[MAINLOOP_READ_MAX];
+
+	assert(epollfd != -1);
+
+	adjust_events_size();
+
+	mainloop_counters.syscalls++;
+	mainloop_counters.wakeups++;
+	r = epoll_wait(epollfd, events, (int)events_size, block ? -1 : 0);
+	mainloop_wakeup();
+	if ((r < 0) && (errno == EINTR)) {
+		return true;
+	}
+
+	if (r < 0) {
+		log_message("epoll_wait error: %m\n");
+		assert(false); /* Anything other than EINTR should not
+				  happen */
+	}
+
+	for (i = 0; i < r; i++) {
+		struct callback_data *cb_data = events[i].data.ptr;
+		uint32_t ev = from_epoll_events(events[i].events);
+		ssize_t nread = 0;
+
+		if (cb_data->read_size > 0U) {
+			assert(cb_data->read_size <= sizeof(buf));
+
+			errno = 0;
+			mainloop_counters.syscalls++;
+			nread = read(cb_data->fd, buf, cb_data->read_size);
+			if (nread < 0) {
+				nread = -errno;
+			}
+		}
+
+		if (!mainloop_queue_event(cb_data, ev, buf, nread)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const struct mainloop_backend mainloop_epoll_backend = {
+    .name = "epoll",
+    .setup = epoll_setup,
+    .close = epoll_close,
+    .add = epoll_add,
+    .modify = epoll_modify,
+    .remove = epoll_remove,
+    .wait = epoll_wait_events,
+};
@@ -0,0 +1,640 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "mainloop-backend.h"
+
+/* io_uring backend. Sources that want their fd read get an IORING_OP_READ
+ * submitted, so that a single io_uring_enter() both waits for and reads the
+ * event. Other fd watches get a poll request. Completed requests are
+ * submitted again after dispatch, and pending submissions are only flushed
+ * when waiting for next events - so an iteration costs just one syscall.
+ *
+ * Each registered source has a slot, whose index and generation are the
+ * user_data of its requests. Removing a source cancels its request and the
+ * slot is only reused after the request is complete - and as generation
+ * changes, stale completions are ignored. */
+
+#ifndef IO_URING_ENTRIES
+#define IO_URING_ENTRIES 64
+#endif
+
+enum slot_state { SLOT_FREE, SLOT_ACTIVE, SLOT_CANCELLING };
+
+struct slot {
+	struct callback_data *cb_data;
+	uint32_t generation;
+	uint32_t events;
+	uint8_t state;
+	bool inflight;
+	bool multishot;
+	void *buf;
+	size_t buf_size;
+};
+
+struct sq_ring {
+	uint32_t *head;
+	uint32_t *tail;
+	uint32_t *ring_mask;
+	uint32_t *ring_entries;
+	uint32_t *array;
+	struct io_uring_sqe *sqes;
+	uint32_t local_tail;
+};
+
+struct cq_ring {
+	uint32_t *head;
+	uint32_t *tail;
+	uint32_t *ring_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static int ring_fd = -1;
+static uint32_t features;
+
+static void *sq_ptr = MAP_FAILED;
+static size_t sq_size;
+static void *cq_ptr = MAP_FAILED;
+static size_t cq_size;
+static struct io_uring_sqe *sqes_ptr = MAP_FAILED;
+static size_t sqes_size;
+
+static struct sq_ring sq;
+static struct cq_ring cq;
+
+static struct slot *slots;
+static size_t slots_size;
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+			      unsigned int min_complete, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg,
+				 unsigned int nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static uint32_t to_poll_events(uint32_t events)
+{
+	uint32_t result = 0;
+
+	if ((events & MAINLOOP_FD_READ) != 0U) {
+		result |= POLLIN;
+	}
+	if ((events & MAINLOOP_FD_WRITE) != 0U) {
+		result |= POLLOUT;
+	}
+	if ((events & MAINLOOP_FD_HANGUP) != 0U) {
+		result |= POLLRDHUP;
+	}
+
+	return result;
+}
+
+static uint32_t from_poll_events(uint32_t events)
+{
+	uint32_t result = 0;
+
+	if ((events & POLLIN) != 0U) {
+		result |= MAINLOOP_FD_READ;
+	}
+	if ((events & POLLOUT) != 0U) {
+		result |= MAINLOOP_FD_WRITE;
+	}
+	if ((events & (POLLHUP | POLLRDHUP)) != 0U) {
+		result |= MAINLOOP_FD_HANGUP;
+	}
+	if ((events & POLLERR) != 0U) {
+		result |= MAINLOOP_FD_ERROR;
+	}
+
+	return result;
+}
+
+/* Kernel must support everything we use, otherwise mainloop falls back to
+ * epoll */
+static bool check_support(void)
+{
+	bool result = false;
+	struct io_uring_probe *probe;
+	size_t probe_size = sizeof(struct io_uring_probe) +
+			    (IORING_OP_LAST * sizeof(struct io_uring_probe_op));
+
+	if (((features & IORING_FEAT_NODROP) == 0U) ||
+	    ((features & IORING_FEAT_FAST_POLL) == 0U)) {
+		log_message("io_uring lacks needed features\n");
+		return false;
+	}
+
+	probe = calloc(1, probe_size);
+	if (probe == NULL) {
+		log_message("Could not allocate io_uring probe: %m\n");
+		return false;
+	}
+
+	if (sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe,
+				  IORING_OP_LAST) < 0) {
+		log_message("Could not probe io_uring: %m\n");
+		goto end;
+	}
+
+	if ((probe->ops_len <= IORING_OP_ASYNC_CANCEL) ||
+	    (probe->ops_len <= IORING_OP_READ)) {
+		goto unsupported;
+	}
+
+	if (((probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) ==
+	     0U) ||
+	    ((probe->ops[IORING_OP_POLL_ADD].flags & IO_URING_OP_SUPPORTED) ==
+	     0U) ||
+	    ((probe->ops[IORING_OP_ASYNC_CANCEL].flags &
+	      IO_URING_OP_SUPPORTED) == 0U)) {
+		goto unsupported;
+	}
+
+	result = true;
+	goto end;
+
+unsupported:
+	log_message("io_uring lacks needed operations\n");
+end:
+	free(probe);
+
+	return result;
+}
+
+static void uring_close(void)
+{
+	size_t i;
+
+	if (sqes_ptr != MAP_FAILED) {
+		(void)munmap(sqes_ptr, sqes_size);
+		sqes_ptr = MAP_FAILED;
+	}
+	if ((cq_ptr != MAP_FAILED) && (cq_ptr != sq_ptr)) {
+		(void)munmap(cq_ptr, cq_size);
+	}
+	cq_ptr = MAP_FAILED;
+	if (sq_ptr != MAP_FAILED) {
+		(void)munmap(sq_ptr, sq_size);
+		sq_ptr = MAP_FAILED;
+	}
+
+	/* Any pending request is cancelled by kernel */
+	if (ring_fd > -1) {
+		(void)close(ring_fd);
+		ring_fd = -1;
+	}
+
+	for (i = 0; i < slots_size; i++) {
+		free(slots[i].buf);
+	}
+	free(slots);
+	slots = NULL;
+	slots_size = 0;
+}
+
+static bool uring_setup(void)
+{
+	struct io_uring_params params = {};
+
+	/* We should not have set up before */
+	assert(ring_fd == -1);
+
+	ring_fd = sys_io_uring_setup(IO_URING_ENTRIES, &params);
+	if (ring_fd < 0) {
+		log_message("Error creating io_uring: %m\n");
+		return false;
+	}
+	features = params.features;
+
+	if (!check_support()) {
+		goto error;
+	}
+
+	sq_size = params.sq_off.array + (params.sq_entries * sizeof(uint32_t));
+	cq_size = params.cq_off.cqes +
+		  (params.cq_entries * sizeof(struct io_uring_cqe));
+	if ((features & IORING_FEAT_SINGLE_MMAP) != 0U) {
+		if (cq_size > sq_size) {
+			sq_size = cq_size;
+		}
+		cq_size = sq_size;
+	}
+
+	sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ptr == MAP_FAILED) {
+		goto mmap_error;
+	}
+
+	if ((features & IORING_FEAT_SINGLE_MMAP) != 0U) {
+		cq_ptr = sq_ptr;
+	} else {
+		cq_ptr =
+		    mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ptr == MAP_FAILED) {
+			goto mmap_error;
+		}
+	}
+
+	sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes_ptr = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sqes_ptr == MAP_FAILED) {
+		goto mmap_error;
+	}
+
+	sq.head = (uint32_t *)((char *)sq_ptr + params.sq_off.head);
+	sq.tail = (uint32_t *)((char *)sq_ptr + params.sq_off.tail);
+	sq.ring_mask = (uint32_t *)((char *)sq_ptr + params.sq_off.ring_mask);
+	sq.ring_entries =
+	    (uint32_t *)((char *)sq_ptr + params.sq_off.ring_entries);
+	sq.array = (uint32_t *)((char *)sq_ptr + params.sq_off.array);
+	sq.sqes = sqes_ptr;
+	sq.local_tail = *sq.tail;
+
+	cq.head = (uint32_t *)((char *)cq_ptr + params.cq_off.head);
+	cq.tail = (uint32_t *)((char *)cq_ptr + params.cq_off.tail);
+	cq.ring_mask = (uint32_t *)((char *)cq_ptr + params.cq_off.ring_mask);
+	cq.cqes = (struct io_uring_cqe *)((char *)cq_ptr + params.cq_off.cqes);
+
+	return true;
+
+mmap_error:
+	log_message("Could not map io_uring rings: %m\n");
+error:
+	uring_close();
+
+	return false;
+}
+
+static unsigned int pending_submissions(void)
+{
+	return sq.local_tail - __atomic_load_n(sq.head, __ATOMIC_ACQUIRE);
+}
+
+static struct io_uring_sqe *get_sqe(void)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t index;
+
+	/* Ring is full, so hand current submissions to kernel now */
+	if (pending_submissions() >= *sq.ring_entries) {
+		mainloop_counters.syscalls++;
+		if (sys_io_uring_enter(ring_fd, pending_submissions(), 0, 0) <
+		    0) {
+			log_message("Could not submit to io_uring: %m\n");
+			return NULL;
+		}
+	}
+
+	index = sq.local_tail & *sq.ring_mask;
+	sqe = &sq.sqes[index];
+	(void)memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sq.array[index] = index;
+
+	return sqe;
+}
+
+static void commit_sqe(void)
+{
+	sq.local_tail++;
+	__atomic_store_n(sq.tail, sq.local_tail, __ATOMIC_RELEASE);
+}
+
+static uint64_t slot_user_data(size_t i)
+{
+	return ((uint64_t)slots[i].generation << 32) | (uint64_t)(i + 1U);
+}
+
+static bool arm_slot(size_t i)
+{
+	struct slot *s = &slots[i];
+	struct io_uring_sqe *sqe;
+
+	assert(s->state == SLOT_ACTIVE);
+	assert(!s->inflight);
+
+	sqe = get_sqe();
+	if (sqe == NULL) {
+		return false;
+	}
+
+	sqe->fd = s->cb_data->fd;
+	sqe->user_data = slot_user_data(i);
+
+	if (s->cb_data->read_size > 0U) {
+		sqe->opcode = IORING_OP_READ;
+		sqe->addr = (uint64_t)(uintptr_t)s->buf;
+		sqe->len = (uint32_t)s->cb_data->read_size;
+		sqe->off = ((features & IORING_FEAT_RW_CUR_POS) != 0U)
+			       ? (uint64_t)-1
+			       : 0U;
+	} else {
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = to_poll_events(s->events);
+		if (s->multishot) {
+			sqe->len = IORING_POLL_ADD_MULTI;
+		}
+	}
+
+	commit_sqe();
+	s->inflight = true;
+
+	return true;
+}
+
+static void free_slot(size_t i)
+{
+	slots[i].state = SLOT_FREE;
+	slots[i].cb_data = NULL;
+	slots[i].generation++;
+}
+
+static bool alloc_slot(size_t *index)
+{
+	size_t i, new_size;
+	struct slot *new_slots;
+
+	for (i = 0; i < slots_size; i++) {
+		if (slots[i].state == SLOT_FREE) {
+			*index = i;
+			return true;
+		}
+	}
+
+	new_size = (slots_size == 0U) ? 8U : slots_size * 2U;
+	new_slots = realloc(slots, new_size * sizeof(struct slot));
+	if (new_slots == NULL) {
+		log_message("Could not grow io_uring slots: %m\n");
+		return false;
+	}
+	(void)memset(new_slots + slots_size, 0,
+		     (new_size - slots_size) * sizeof(struct slot));
+
+	*index = slots_size;
+	slots = new_slots;
+	slots_size = new_size;
+
+	return true;
+}
+
+/* Reads are done by io_uring on our behalf, so fd doesn't need to be non
+ * blocking - and must not be, or reads would fail instead of waiting */
+static bool clear_nonblock(int fd)
+{
+	int flags;
+
+	mainloop_counters.syscalls++;
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0) {
+		return false;
+	}
+
+	if ((flags & O_NONBLOCK) == 0) {
+		return true;
+	}
+
+	mainloop_counters.syscalls++;
+	return fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == 0;
+}
+
+static bool uring_add(struct callback_data *cb_data, uint32_t events)
+{
+	size_t i;
+	struct slot *s;
+
+	assert(ring_fd > -1);
+	assert(cb_data->fd > -1);
+	assert(cb_data->read_size <= MAINLOOP_READ_MAX);
+
+	log_message("Adding %d to %d io_uring\n", cb_data->fd, ring_fd);
+
+	if (!alloc_slot(&i)) {
+		return false;
+	}
+	s = &slots[i];
+
+	if (cb_data->read_size > 0U) {
+		if (s->buf_size < cb_data->read_size) {
+			void *buf = realloc(s->buf, cb_data->read_size);
+
+			if (buf == NULL) {
+				log_message("Could not allocate read buffer: "
+					    "%m\n");
+				return false;
+			}
+			s->buf = buf;
+			s->buf_size = cb_data->read_size;
+		}
+
+		if (!clear_nonblock(cb_data->fd)) {
+			log_message("Could not set fd %d blocking: %m\n",
+				    cb_data->fd);
+			return false;
+		}
+	}
+
+	s->cb_data = cb_data;
+	s->events = events;
+	s->multishot = (events & MAINLOOP_FD_EDGE) != 0U;
+	s->state = SLOT_ACTIVE;
+	s->inflight = false;
+
+	if (!arm_slot(i)) {
+		free_slot(i);
+		return false;
+	}
+
+	cb_data->backend_slot = (int32_t)i;
+
+	return true;
+}
+
+static void uring_remove(struct callback_data *cb_data)
+{
+	size_t i;
+	struct slot *s;
+	struct io_uring_sqe *sqe;
+
+	if ((ring_fd < 0) || (cb_data->backend_slot < 0)) {
+		return;
+	}
+
+	i = (size_t)cb_data->backend_slot;
+	assert(i < slots_size);
+	s = &slots[i];
+	assert(s->cb_data == cb_data);
+
+	log_message("Removing %d from %d io_uring\n", cb_data->fd, ring_fd);
+
+	cb_data->backend_slot = -1;
+
+	/* Not armed, as it is being dispatched */
+	if (!s->inflight) {
+		free_slot(i);
+		return;
+	}
+
+	s->state = SLOT_CANCELLING;
+	s->cb_data = NULL;
+
+	sqe = get_sqe();
+	if (sqe == NULL) {
+		/* Slot is leaked until its request completes by itself */
+		return;
+	}
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = slot_user_data(i);
+	sqe->user_data = 0; /* Its completion is not interesting */
+	commit_sqe();
+}
+
+static bool uring_modify(struct callback_data *cb_data, uint32_t events)
+{
+	uring_remove(cb_data);
+
+	return uring_add(cb_data, events);
+}
+
+static bool handle_cqe(uint64_t user_data, int32_t res, uint32_t flags)
+{
+	size_t i;
+	struct slot *s;
+	struct callback_data *cb_data;
+	uint32_t ev;
+	ssize_t nread = 0;
+
+	if (user_data == 0U) {
+		return true;
+	}
+
+	i = (size_t)(user_data & UINT32_MAX) - 1U;
+	if ((i >= slots_size) ||
+	    (slots[i].generation != (uint32_t)(user_data >> 32))) {
+		return true;
+	}
+
+	s = &slots[i];
+	if ((flags & IORING_CQE_F_MORE) == 0U) {
+		s->inflight = false;
+	}
+
+	if (s->state == SLOT_CANCELLING) {
+		if (!s->inflight) {
+			free_slot(i);
+		}
+		return true;
+	}
+
+	if (s->state != SLOT_ACTIVE) {
+		return true;
+	}
+
+	cb_data = s->cb_data;
+
+	if (cb_data->read_size > 0U) {
+		ev = MAINLOOP_FD_READ;
+		nread = res;
+	} else if ((res == -EINVAL) && s->multishot) {
+		/* No multishot poll on this kernel, rearm after each event */
+		s->multishot = false;
+		return arm_slot(i);
+	} else if (res < 0) {
+		ev = MAINLOOP_FD_ERROR;
+	} else {
+		ev = from_poll_events((uint32_t)res);
+	}
+
+	if (!mainloop_queue_event(cb_data, ev, s->buf, nread)) {
+		return false;
+	}
+
+	/* Request is only submitted on next wait, after this batch is
+	 * dispatched */
+	if (!s->inflight) {
+		return arm_slot(i);
+	}
+
+	return true;
+}
+
+static bool uring_wait(bool block)
+{
+	int r;
+	uint32_t head, tail;
+
+	assert(ring_fd != -1);
+
+	mainloop_counters.wakeups++;
+
+	/* If not blocking, completions can be collected without a syscall -
+	 * unless there's something to submit */
+	if (block || (pending_submissions() > 0U)) {
+		mainloop_counters.syscalls++;
+		r = sys_io_uring_enter(ring_fd, pending_submissions(),
+				       block ? 1U : 0U,
+				       block ? IORING_ENTER_GETEVENTS : 0U);
+		if ((r < 0) && (errno != EINTR) && (errno != EAGAIN) &&
+		    (errno != EBUSY)) {
+			log_message("io_uring_enter error: %m\n");
+			assert(false); /* Should not happen */
+		}
+	}
+	mainloop_wakeup();
+
+	head = *cq.head;
+	tail = __atomic_load_n(cq.tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &cq.cqes[head & *cq.ring_mask];
+		uint64_t user_data = cqe->user_data;
+		int32_t res = cqe->res;
+		uint32_t flags = cqe->flags;
+
+		/* Release entry before dispatching, callbacks may take long */
+		head++;
+		__atomic_store_n(cq.head, head, __ATOMIC_RELEASE);
+
+		if (!handle_cqe(user_data, res, flags)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const struct mainloop_backend mainloop_io_uring_backend = {
+    .name = "io_uring",
+    .setup = uring_setup,
+    .close = uring_close,
+    .add = uring_add,
+    .modify = uring_modify,
+    .remove = uring_remove,
+    .wait = uring_wait,
+};
@@ -7,86 +7,635 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/epoll.h>
+#include <string.h>
 #include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "histogram.h"
 #include "log.h"
+#include "macros.h"
+#include "mainloop-backend.h"
 #include "mainloop.h"
+#include "timer-wheel.h"
 
-#define MAX_EVENTS 8
-
-enum callback_type { CALLBACK_SIGNAL, CALLBACK_TIMEOUT };
-
-struct callback_data {
-	int fd;
-	enum callback_type type;
+struct mainloop_signal_handler {
+	struct callback_data cb_data;
+	void (*callback)(struct signalfd_siginfo *info, size_t count);
 };
 
-struct mainloop_signal_handler {
+struct mainloop_fd_watch {
 	struct callback_data cb_data;
-	void (*callback)(struct signalfd_siginfo *info);
+	uint32_t events;
+	void (*callback)(int fd, uint32_t events, void *data);
+	void *data;
 };
 
+/* All timeouts are multiplexed on a single timerfd, that is armed to fire
+ * on the next event of the timer wheel. Wheel ticks are milliseconds since
+ * `clock_base` */
 struct mainloop_timeout {
-	struct callback_data cb_data;
+	struct timer_wheel_node node;
+	uint32_t interval;
 	enum timeout_result (*callback)(void);
+	/* Used instead of `callback` by timeouts added with data */
+	enum timeout_result (*data_callback)(void *data);
+	void *data;
+	enum mainloop_priority priority;
+	bool queued;  /* Expired, waiting for dispatch on current batch */
+	bool removed; /* Removed while queued, to be freed by dispatch */
+};
+
+/* Events collected on a wake up form a batch, dispatched by priority - and
+ * by arrival order within same priority. Data read by backends is copied to
+ * `batch_buf`. Expired timeouts are individual items */
+struct work_item {
+	struct callback_data *cb_data; /* NULL for timeouts */
+	struct mainloop_timeout *timeout;
+	uint32_t events;
+	ssize_t nread;
+	size_t buf_offset;
+	enum mainloop_priority priority;
+};
+
+/* Iterations taking longer than this, from wake up until post iteration
+ * callback finishes, are logged as stalls. Zero disables the check */
+#ifndef MAINLOOP_STALL_BUDGET_MS
+#define MAINLOOP_STALL_BUDGET_MS 50
+#endif
+
+/* Latency is measured from wake up to callback dispatch - or, for timeouts,
+ * from the moment they were due */
+struct callback_stats {
+	struct histogram latency;
+	struct histogram duration;
+};
+
+static const char *const source_type_names[MAINLOOP_SOURCE_TYPES] = {
+    [MAINLOOP_SOURCE_SIGNAL] = "signal",
+    [MAINLOOP_SOURCE_TIMEOUT] = "timeout",
+    [MAINLOOP_SOURCE_FD] = "fd",
+    [MAINLOOP_SOURCE_POST_ITERATION] = "post-iteration",
+    [MAINLOOP_SOURCE_IDLE] = "idle",
+};
+
+/* Idle callbacks run, in FIFO order, only after a non blocking wait finds no
+ * pending event - and only for this long per iteration. A callback that keeps
+ * running goes back to the end of the queue */
+#ifndef MAINLOOP_IDLE_BUDGET_US
+#define MAINLOOP_IDLE_BUDGET_US 2000
+#endif
+
+struct mainloop_idle {
+	struct mainloop_idle *next;
+	enum idle_result (*callback)(void *data);
+	void (*deferred)(void *data); /* If set, runs once instead */
+	void *data;
+	uint64_t queued_ns;
 };
 
-static int epollfd = -1;
+struct mainloop_counters mainloop_counters;
+
+static struct callback_stats stats[MAINLOOP_SOURCE_TYPES];
+static uint64_t stall_budget_ns = MAINLOOP_STALL_BUDGET_MS * 1000000ULL;
+static uint64_t stalls;
+static uint64_t wakeup_ns;
+static uint64_t slowest_ns;
+static enum mainloop_source_type slowest_type;
+
+static const struct mainloop_backend *backend;
 static bool should_exit = true;
 static void (*post_iteration_callback)(void);
+static bool post_iteration_pending;
+
+static struct mainloop_idle *idle_queue;
+static struct mainloop_idle **idle_queue_tail = &idle_queue;
+static struct mainloop_idle *running_idle;
+
+static bool dispatching;
+static struct callback_data *removed_sources;
+
+static struct work_item *batch;
+static size_t batch_size;
+static size_t batch_used;
+static size_t batch_count[MAINLOOP_PRIORITIES];
+static unsigned char *batch_buf;
+static size_t batch_buf_size;
+static size_t batch_buf_used;
+
+/* Timerfd events are not queued, but used to collect expired timeouts */
+static struct callback_data timer_cb_data = {
+    .fd = -1,
+    .read_size = sizeof(uint64_t),
+    .type = MAINLOOP_SOURCE_TIMEOUT};
+static struct timer_wheel timer_wheel;
+static struct timespec clock_base;
+static uint64_t armed_tick;
+static bool timer_armed;
+static struct mainloop_timeout *running_timeout;
+
+static void release_source(struct callback_data *cb_data)
+{
+	if (dispatching) {
+		cb_data->removed = true;
+		cb_data->next_removed = removed_sources;
+		removed_sources = cb_data;
+	} else {
+		free(cb_data);
+	}
+}
+
+static void free_removed_sources(void)
+{
+	while (removed_sources != NULL) {
+		struct callback_data *cb_data = removed_sources;
+
+		removed_sources = cb_data->next_removed;
+		free(cb_data);
+	}
+}
+
+static uint64_t monotonic_ns(void)
+{
+	int r;
+	struct timespec ts;
+
+	r = clock_gettime(CLOCK_MONOTONIC, &ts);
+	assert(r == 0);
+
+	return ((uint64_t)ts.tv_sec * 1000000000U) + (uint64_t)ts.tv_nsec;
+}
+
+static void record_callback(enum mainloop_source_type type,
+			    uint64_t latency_ns, uint64_t start_ns,
+			    uint64_t end_ns)
+{
+	uint64_t duration_ns = end_ns - start_ns;
+
+	histogram_add(&stats[type].latency, latency_ns);
+	histogram_add(&stats[type].duration, duration_ns);
+
+	if (duration_ns > slowest_ns) {
+		slowest_ns = duration_ns;
+		slowest_type = type;
+	}
+}
+
+void mainloop_wakeup(void)
+{
+	wakeup_ns = monotonic_ns();
+	slowest_ns = 0;
+}
 
-static bool add_fd(int fd, struct callback_data *data)
+static uint64_t current_tick(void)
+{
+	int r;
+	struct timespec ts;
+
+	r = clock_gettime(CLOCK_MONOTONIC, &ts);
+	assert(r == 0);
+
+	return (((uint64_t)(ts.tv_sec - clock_base.tv_sec) * 1000000000U) +
+		(uint64_t)ts.tv_nsec - (uint64_t)clock_base.tv_nsec) /
+	       1000000U;
+}
+
+/* Arms timerfd to next wheel event, if it is not already armed to it. Note
+ * that timerfd is never disarmed when timeouts are removed: an eventual
+ * spurious wake up simply finds nothing to expire */
+static void arm_timer(void)
+{
+	int r;
+	uint64_t tick;
+	struct itimerspec ts = {};
+
+	if (!timer_wheel_next_event(&timer_wheel, &tick)) {
+		return;
+	}
+
+	if (timer_armed && (tick == armed_tick)) {
+		return;
+	}
+
+	ts.it_value.tv_sec = clock_base.tv_sec + (time_t)(tick / 1000U);
+	ts.it_value.tv_nsec =
+	    clock_base.tv_nsec + ((long)(tick % 1000U) * 1000000);
+	if (ts.it_value.tv_nsec >= 1000000000) {
+		ts.it_value.tv_sec++;
+		ts.it_value.tv_nsec -= 1000000000;
+	}
+
+	mainloop_counters.syscalls++;
+	r = timerfd_settime(timer_cb_data.fd, TFD_TIMER_ABSTIME, &ts, NULL);
+	assert(r == 0);
+
+	armed_tick = tick;
+	timer_armed = true;
+}
+
+static uint64_t timeout_due_ns(const struct mainloop_timeout *mt)
+{
+	return (((uint64_t)clock_base.tv_sec * 1000000000U) +
+		(uint64_t)clock_base.tv_nsec) +
+	       (mt->node.expires * 1000000U);
+}
+
+static void reschedule_timeout(struct mainloop_timeout *mt)
+{
+	uint64_t now = current_tick();
+	uint64_t expires = mt->node.expires + mt->interval;
+
+	/* Don't try to catch up lost periods */
+	if (expires <= now) {
+		expires = now + mt->interval;
+	}
+	timer_wheel_add(&timer_wheel, &mt->node, expires);
+}
+
+static bool dispatch_item(struct work_item *item, const void *buf)
 {
 	bool result = true;
-	struct epoll_event epev = {};
+	uint64_t start_ns = monotonic_ns();
+	uint64_t ready_ns = wakeup_ns;
+	enum mainloop_source_type type;
 
-	assert(epollfd > -1);
-	assert(fd > -1);
+	if (item->timeout != NULL) {
+		struct mainloop_timeout *mt = item->timeout;
+		enum timeout_result r;
+
+		mt->queued = false;
+		if (mt->removed) {
+			free(mt);
+			return true;
+		}
+
+		type = MAINLOOP_SOURCE_TIMEOUT;
+		ready_ns = timeout_due_ns(mt);
+		if (ready_ns > start_ns) {
+			ready_ns = start_ns;
+		}
 
-	epev.events = EPOLLIN;
-	epev.data.ptr = data;
+		running_timeout = mt;
+		if (mt->data_callback != NULL) {
+			r = mt->data_callback(mt->data);
+		} else {
+			r = mt->callback();
+		}
+		running_timeout = NULL;
+
+		if (r == TIMEOUT_CONTINUE) {
+			reschedule_timeout(mt);
+		} else {
+			free(mt);
+		}
+	} else {
+		/* Removed by a previous callback on this batch */
+		if (item->cb_data->removed) {
+			return true;
+		}
 
-	log_message("Adding %d to %d epoll\n", fd, epollfd);
+		type = item->cb_data->type;
 
-	if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &epev) < 0) {
-		log_message("Error adding file descriptor to epoll: %m\n");
-		result = false;
+		errno = 0;
+		result = item->cb_data->dispatch(item->cb_data, item->events,
+						 buf, item->nread);
 	}
 
+	mainloop_counters.events++;
+	record_callback(type, start_ns - ready_ns, start_ns, monotonic_ns());
+
 	return result;
 }
 
-static void remove_fd(int fd)
+/* Used if batch can't grow, or to dispose items after a failed dispatch */
+static void discard_item(struct work_item *item)
 {
-	if ((fd > -1) && (epollfd > -1)) {
-		log_message("Removing %d from %d epoll\n", fd, epollfd);
+	struct mainloop_timeout *mt = item->timeout;
 
-		errno = 0;
-		if (epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL) < 0) {
-			log_message("Could not remove file descriptor from "
-				    "epoll: %m\n");
+	if (mt != NULL) {
+		mt->queued = false;
+		if (mt->removed) {
+			free(mt);
+		} else {
+			timer_wheel_add(&timer_wheel, &mt->node,
+					mt->node.expires);
 		}
 	}
 }
 
-bool mainloop_setup(void)
+static struct work_item *new_work_item(size_t data_size)
 {
-	bool result = true;
+	struct work_item *item;
 
-	/* We should not have set up before */
-	assert(epollfd == -1);
+	if (batch_used == batch_size) {
+		size_t new_size = (batch_size == 0U) ? 16U : batch_size * 2U;
+		struct work_item *new_batch =
+		    realloc(batch, new_size * sizeof(struct work_item));
+
+		if (new_batch == NULL) {
+			return NULL;
+		}
+		batch = new_batch;
+		batch_size = new_size;
+	}
+
+	if ((batch_buf_used + data_size) > batch_buf_size) {
+		size_t new_size = (batch_buf_size == 0U) ? 1024U : batch_buf_size;
+		unsigned char *new_buf;
+
+		while ((batch_buf_used + data_size) > new_size) {
+			new_size *= 2U;
+		}
+
+		new_buf = realloc(batch_buf, new_size);
+		if (new_buf == NULL) {
+			return NULL;
+		}
+		batch_buf = new_buf;
+		batch_buf_size = new_size;
+	}
+
+	item = &batch[batch_used];
+	(void)memset(item, 0, sizeof(struct work_item));
+	item->buf_offset = batch_buf_used;
+
+	return item;
+}
+
+static void commit_work_item(struct work_item *item, size_t data_size)
+{
+	batch_used++;
+	batch_buf_used += data_size;
+	batch_count[item->priority]++;
+}
+
+static void queue_timeout(struct mainloop_timeout *mt)
+{
+	struct work_item *item = new_work_item(0);
+
+	mt->queued = true;
+
+	if (item == NULL) {
+		struct work_item now = {.timeout = mt};
+
+		log_message("Could not queue timeout, dispatching it now\n");
+		(void)dispatch_item(&now, NULL);
+		return;
+	}
+
+	item->timeout = mt;
+	item->priority = mt->priority;
+	commit_work_item(item, 0);
+}
+
+static bool collect_timeouts(ssize_t nread);
+
+/* Called by backends for each event */
+bool mainloop_queue_event(struct callback_data *cb_data, uint32_t events,
+			  const void *buf, ssize_t nread)
+{
+	size_t data_size = (nread > 0) ? (size_t)nread : 0U;
+	struct work_item *item;
+
+	if (cb_data == &timer_cb_data) {
+		return collect_timeouts(nread);
+	}
+
+	item = new_work_item(data_size);
+	if (item == NULL) {
+		struct work_item now = {
+		    .cb_data = cb_data, .events = events, .nread = nread};
+
+		log_message("Could not queue event, dispatching it now\n");
+		return dispatch_item(&now, buf);
+	}
 
-	epollfd = epoll_create1(EPOLL_CLOEXEC);
-	if (epollfd == -1) {
-		log_message("Error creating epoll fd: %m\n");
-		result = false;
+	item->cb_data = cb_data;
+	item->events = events;
+	item->nread = nread;
+	item->priority = cb_data->priority;
+	if (data_size > 0U) {
+		(void)memcpy(batch_buf + item->buf_offset, buf, data_size);
 	}
+	commit_work_item(item, data_size);
+
+	return true;
+}
+
+/* Bucketed stable sort: one pass over the batch for each priority that has
+ * items. If a dispatch fails, remaining items are discarded */
+static bool dispatch_batch(bool result)
+{
+	size_t i;
+	unsigned int p;
+
+	for (p = 0; p < MAINLOOP_PRIORITIES; p++) {
+		if (batch_count[p] == 0U) {
+			continue;
+		}
+
+		for (i = 0; i < batch_used; i++) {
+			struct work_item *item = &batch[i];
+
+			if (item->priority != p) {
+				continue;
+			}
+
+			if (result) {
+				result = dispatch_item(
+				    item, batch_buf + item->buf_offset);
+			} else {
+				discard_item(item);
+			}
+		}
+
+		batch_count[p] = 0;
+	}
+
+	batch_used = 0;
+	batch_buf_used = 0;
+
+	arm_timer();
 
 	return result;
 }
 
+static void check_stall(void)
+{
+	uint64_t elapsed_ns = monotonic_ns() - wakeup_ns;
+
+	if ((stall_budget_ns == 0U) || (elapsed_ns <= stall_budget_ns)) {
+		return;
+	}
+
+	stalls++;
+	log_message("Mainloop stall: iteration took %llu us, budget is %llu us. "
+		    "Slowest callback was %s, taking %llu us\n",
+		    (unsigned long long)(elapsed_ns / 1000U),
+		    (unsigned long long)(stall_budget_ns / 1000U),
+		    source_type_names[slowest_type],
+		    (unsigned long long)(slowest_ns / 1000U));
+}
+
+/* Expired timeouts are queued on current batch, so they are dispatched
+ * according to their priority */
+static bool collect_timeouts(ssize_t nread)
+{
+	struct timer_wheel_node *expired = NULL;
+
+	/* If timerfd was rearmed after this event was reported, there's
+	 * nothing to read - but still no harm in looking for expired ones */
+	if ((nread != (ssize_t)sizeof(uint64_t)) && (nread != -EAGAIN)) {
+		errno = (nread < 0) ? (int)-nread : 0;
+		log_message("Error reading timeout: %m\n");
+		return false;
+	}
+
+	timer_armed = false;
+	timer_wheel_advance(&timer_wheel, current_tick(), &expired);
+
+	while (expired != NULL) {
+		struct mainloop_timeout *mt =
+		    (struct mainloop_timeout *)expired;
+
+		timer_wheel_remove(&timer_wheel, &mt->node);
+		queue_timeout(mt);
+	}
+
+	return true;
+}
+
+static const struct mainloop_backend *
+select_backend(enum mainloop_backend_type type)
+{
+	const struct mainloop_backend *result = NULL;
+
+	switch (type) {
+	case MAINLOOP_BACKEND_AUTO:
+#ifdef MAINLOOP_IO_URING
+		if (mainloop_io_uring_backend.setup()) {
+			result = &mainloop_io_uring_backend;
+			break;
+		}
+		log_message("io_uring not available, falling back to epoll\n");
+#endif
+		if (mainloop_epoll_backend.setup()) {
+			result = &mainloop_epoll_backend;
+		}
+		break;
+	case MAINLOOP_BACKEND_EPOLL:
+		if (mainloop_epoll_backend.setup()) {
+			result = &mainloop_epoll_backend;
+		}
+		break;
+	case MAINLOOP_BACKEND_IO_URING:
+#ifdef MAINLOOP_IO_URING
+		if (mainloop_io_uring_backend.setup()) {
+			result = &mainloop_io_uring_backend;
+		}
+#else
+		log_message("io_uring backend not built\n");
+#endif
+		break;
+	default:
+		assert(false);
+		break;
+	}
+
+	return result;
+}
+
+bool mainloop_setup_backend(enum mainloop_backend_type type)
+{
+	int r;
+
+	/* We should not have set up before */
+	assert(backend == NULL);
+
+	backend = select_backend(type);
+	if (backend == NULL) {
+		goto backend_error;
+	}
+
+	log_message("Mainloop using %s backend\n", backend->name);
+
+	timer_cb_data.fd =
+	    timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (timer_cb_data.fd < 0) {
+		log_message("Error creating timer fd: %m\n");
+		goto timerfd_error;
+	}
+
+	if (!backend->add(&timer_cb_data, MAINLOOP_FD_READ)) {
+		goto add_fd_error;
+	}
+
+	r = clock_gettime(CLOCK_MONOTONIC, &clock_base);
+	assert(r == 0);
+
+	timer_wheel_init(&timer_wheel, 0);
+	timer_armed = false;
+
+	return true;
+
+add_fd_error:
+	(void)close(timer_cb_data.fd);
+	timer_cb_data.fd = -1;
+timerfd_error:
+	backend->close();
+	backend = NULL;
+backend_error:
+	return false;
+}
+
+bool mainloop_setup(void)
+{
+	return mainloop_setup_backend(MAINLOOP_BACKEND_AUTO);
+}
+
+const char *mainloop_backend_name(void)
+{
+	return (backend != NULL) ? backend->name : "none";
+}
+
+void mainloop_get_counters(struct mainloop_counters *counters)
+{
+	assert(counters != NULL);
+
+	*counters = mainloop_counters;
+}
+
+void mainloop_set_stall_budget(uint32_t msec)
+{
+	stall_budget_ns = (uint64_t)msec * 1000000U;
+}
+
+void mainloop_dump_stats(int fd)
+{
+	size_t i;
+	char name[64];
+
+	(void)dprintf(fd, "Mainloop backend: %s\n", mainloop_backend_name());
+	(void)dprintf(fd,
+		      "Mainloop counters: %llu syscalls, %llu wakeups, %llu "
+		      "events\n",
+		      (unsigned long long)mainloop_counters.syscalls,
+		      (unsigned long long)mainloop_counters.wakeups,
+		      (unsigned long long)mainloop_counters.events);
+	(void)dprintf(fd, "Mainloop stalls: %llu (budget %llu us)\n",
+		      (unsigned long long)stalls,
+		      (unsigned long long)(stall_budget_ns / 1000U));
+
+	for (i = 0; i < MAINLOOP_SOURCE_TYPES; i++) {
+		(void)snprintf(name, sizeof(name), "%s latency",
+			       source_type_names[i]);
+		histogram_dump(&stats[i].latency, name, fd);
+		(void)snprintf(name, sizeof(name), "%s duration",
+			       source_type_names[i]);
+		histogram_dump(&stats[i].duration, name, fd);
+	}
+}
+
 void mainloop_exit(void)
 {
 	assert(!should_exit);
@@ -94,164 +643,345 @@ void mainloop_exit(void)
 	should_exit = true;
 }
 
+static void close_fds(void)
+{
+	backend->close();
+	backend = NULL;
+
+	(void)close(timer_cb_data.fd);
+	timer_cb_data.fd = -1;
+	timer_armed = false;
+
+	free(batch);
+	batch = NULL;
+	batch_size = 0;
+	free(batch_buf);
+	batch_buf = NULL;
+	batch_buf_size = 0;
+}
+
+/* Runs post iteration callback if there was any state change since its last
+ * run. It runs again if it changed state itself */
+static void run_post_iteration(void)
+{
+	while (post_iteration_pending && (post_iteration_callback != NULL) &&
+	       !should_exit) {
+		uint64_t start_ns = monotonic_ns();
+
+		post_iteration_pending = false;
+		post_iteration_callback();
+
+		record_callback(MAINLOOP_SOURCE_POST_ITERATION,
+				start_ns - wakeup_ns, start_ns, monotonic_ns());
+	}
+}
+
+/* A new callback always runs at the end of current iteration */
 void mainloop_set_post_iteration_callback(void (*cb)(void))
 {
 	post_iteration_callback = cb;
+	if (cb != NULL) {
+		post_iteration_pending = true;
+	}
+}
+
+void mainloop_request_post_iteration(void)
+{
+	post_iteration_pending = true;
+}
+
+static void queue_idle(struct mainloop_idle *mi)
+{
+	mi->next = NULL;
+	*idle_queue_tail = mi;
+	idle_queue_tail = &mi->next;
+}
+
+static struct mainloop_idle *dequeue_idle(void)
+{
+	struct mainloop_idle *mi = idle_queue;
+
+	if (mi != NULL) {
+		idle_queue = mi->next;
+		if (idle_queue == NULL) {
+			idle_queue_tail = &idle_queue;
+		}
+	}
+
+	return mi;
+}
+
+static void run_idle(void)
+{
+	uint64_t start_ns = monotonic_ns();
+	uint64_t now_ns = start_ns;
+
+	while ((idle_queue != NULL) && !should_exit &&
+	       ((now_ns - start_ns) < (MAINLOOP_IDLE_BUDGET_US * 1000ULL))) {
+		struct mainloop_idle *mi = dequeue_idle();
+		enum idle_result result = IDLE_STOP;
+		uint64_t cb_start_ns = now_ns;
+
+		running_idle = mi;
+		if (mi->deferred != NULL) {
+			mi->deferred(mi->data);
+		} else {
+			result = mi->callback(mi->data);
+		}
+		running_idle = NULL;
+
+		now_ns = monotonic_ns();
+		record_callback(MAINLOOP_SOURCE_IDLE,
+				cb_start_ns - mi->queued_ns, cb_start_ns, now_ns);
+
+		if (result == IDLE_CONTINUE) {
+			mi->queued_ns = now_ns;
+			queue_idle(mi);
+		} else {
+			free(mi);
+		}
+	}
+}
+
+/* Pending idle work is dropped when mainloop finishes */
+static void free_idle_queue(void)
+{
+	struct mainloop_idle *mi;
+	unsigned int dropped = 0;
+
+	while ((mi = dequeue_idle()) != NULL) {
+		free(mi);
+		dropped++;
+	}
+
+	if (dropped > 0U) {
+		log_message("Dropped %u pending idle callbacks\n", dropped);
+	}
 }
 
 bool mainloop_start(void)
 {
-	assert(epollfd != -1);
+	bool result = true;
+
+	assert(backend != NULL);
 	assert(should_exit);
 
 	should_exit = false;
+
+	/* Handle any state changes from before mainloop started */
+	mainloop_wakeup();
+	run_post_iteration();
+
 	while (!should_exit) {
-		int i, r;
-		ssize_t s;
-		struct epoll_event events[MAX_EVENTS] = {};
+		/* With idle work to do, only check for events */
+		bool block = idle_queue == NULL;
+		uint64_t events = mainloop_counters.events;
 
-		r = epoll_wait(epollfd, events, MAX_EVENTS, -1);
-		if ((r < 0) && (errno == EINTR)) {
-			continue;
+		dispatching = true;
+		result = backend->wait(block);
+		result = dispatch_batch(result);
+		dispatching = false;
+		free_removed_sources();
+
+		if (!result) {
+			break;
 		}
 
-		if (r < 0) {
-			log_message("epoll_wait error: %m\n");
-			assert(false); /* Anything other than EINTR should not
-					  happen */
+		/* State machine runs once per batch of events */
+		run_post_iteration();
+
+		if (!block && (events == mainloop_counters.events)) {
+			run_idle();
+			run_post_iteration();
 		}
 
-		for (i = 0; i < r; i++) {
-			struct callback_data *cb_data = events[i].data.ptr;
-
-			errno = 0;
-
-			switch (cb_data->type) {
-			case CALLBACK_SIGNAL: {
-				struct signalfd_siginfo info;
-
-				s = read(cb_data->fd, &info,
-					 sizeof(struct signalfd_siginfo));
-				if (s !=
-				    (ssize_t)sizeof(struct signalfd_siginfo)) {
-					log_message(
-					    "A Error reading signal: %m\n");
-					goto error_reading;
-				}
-				((struct mainloop_signal_handler *)cb_data)
-				    ->callback(&info);
-				break;
-			}
-			case CALLBACK_TIMEOUT: {
-				uint64_t u;
-
-				s = read(cb_data->fd, &u, sizeof(uint64_t));
-				if (s != (ssize_t)sizeof(uint64_t)) {
-					log_message(
-					    "Error reading timeout: %m\n");
-					goto error_reading;
-				}
-				if (((struct mainloop_timeout *)cb_data)
-					->callback() != TIMEOUT_CONTINUE) {
-					mainloop_remove_timeout(
-					    (struct mainloop_timeout *)cb_data);
-				}
-				break;
-			}
-			default: {
-				log_message("Unexpected callback type %d\n",
-					    cb_data->type);
-				break;
-			}
-			}
+		check_stall();
+	}
 
-			if (post_iteration_callback != NULL) {
-				post_iteration_callback();
+	free_idle_queue();
+	close_fds();
+
+	return result;
+}
+
+static struct mainloop_idle *add_idle(enum idle_result (*idle_cb)(void *data),
+				      void (*defer_cb)(void *data), void *data)
+{
+	struct mainloop_idle *mi;
+
+	errno = 0;
+	mi = calloc(1, sizeof(struct mainloop_idle));
+	if (mi == NULL) {
+		log_message("Could not add idle callback: %m\n");
+		return NULL;
+	}
+
+	mi->callback = idle_cb;
+	mi->deferred = defer_cb;
+	mi->data = data;
+	mi->queued_ns = monotonic_ns();
+
+	queue_idle(mi);
+
+	return mi;
+}
+
+/* Runs `idle_cb` when there's nothing else to do, until it returns
+ * IDLE_STOP. It should do its work in small steps, returning IDLE_CONTINUE
+ * while there's more to do */
+struct mainloop_idle *
+mainloop_add_idle(enum idle_result (*idle_cb)(void *data), void *data)
+{
+	assert(idle_cb != NULL);
+
+	return add_idle(idle_cb, NULL, data);
+}
+
+/* Must not be called by an idle callback on itself - it should return
+ * IDLE_STOP instead */
+void mainloop_remove_idle(struct mainloop_idle *mi)
+{
+	struct mainloop_idle **pp;
+
+	assert(mi != NULL);
+	assert(mi != running_idle);
+
+	for (pp = &idle_queue; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == mi) {
+			*pp = mi->next;
+			if (*pp == NULL) {
+				idle_queue_tail = pp;
 			}
+			break;
 		}
 	}
 
-	close(epollfd);
-	epollfd = -1;
-
-	return true;
+	free(mi);
+}
 
-error_reading:
-	close(epollfd);
+/* Runs `defer_cb` once, when there's nothing else to do */
+bool mainloop_defer(void (*defer_cb)(void *data), void *data)
+{
+	assert(defer_cb != NULL);
 
-	return false;
+	return add_idle(NULL, defer_cb, data) != NULL;
 }
 
-struct mainloop_timeout *
-mainloop_add_timeout(uint32_t msec, enum timeout_result (*timeout_cb)(void))
+static struct mainloop_timeout *
+add_timeout(uint32_t msec, enum timeout_result (*timeout_cb)(void),
+	    enum timeout_result (*data_timeout_cb)(void *data), void *data)
 {
-	int timerfd, r;
-	struct itimerspec ts = {};
+	uint64_t expires;
 	struct mainloop_timeout *mt = NULL;
 
 	assert(msec != 0U);
-	assert(timeout_cb != NULL);
-	assert(epollfd != -1);
+	assert(backend != NULL);
 
 	errno = 0;
 	mt = calloc(1, sizeof(struct mainloop_timeout));
 	if (mt == NULL) {
 		log_message("Could not add timeout: %m\n");
-		goto alloc_error;
+		goto end;
 	}
 
-	mt->cb_data.type = CALLBACK_TIMEOUT;
+	mt->interval = msec;
 	mt->callback = timeout_cb;
+	mt->data_callback = data_timeout_cb;
+	mt->data = data;
+	mt->priority = MAINLOOP_PRIORITY_LOW;
 
-	timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
-	if (timerfd < 0) {
-		log_message("Could not add timeout: %m\n");
-		goto timerfd_error;
-	}
-	mt->cb_data.fd = timerfd;
-
-	ts.it_value.tv_sec = (time_t)msec / 1000;
-	ts.it_value.tv_nsec = ((long)msec % 1000) * 1000000;
-	ts.it_interval.tv_sec = ts.it_value.tv_sec;
-	ts.it_interval.tv_nsec = ts.it_value.tv_nsec;
-	r = timerfd_settime(timerfd, 0, &ts, NULL);
-	assert(r == 0);
+	expires = current_tick() + msec;
+	timer_wheel_add(&timer_wheel, &mt->node, expires);
 
-	if (!add_fd(timerfd, &mt->cb_data)) {
-		goto add_fd_error;
+	/* Only touch timerfd if this timeout is due before current armed
+	 * event */
+	if (!timer_armed || (expires < armed_tick)) {
+		arm_timer();
 	}
 
+end:
 	return mt;
+}
 
-add_fd_error:
-	close(timerfd);
-timerfd_error:
-alloc_error:
-	free(mt);
+struct mainloop_timeout *
+mainloop_add_timeout(uint32_t msec, enum timeout_result (*timeout_cb)(void))
+{
+	assert(timeout_cb != NULL);
 
-	return NULL;
+	return add_timeout(msec, timeout_cb, NULL, NULL);
+}
+
+struct mainloop_timeout *
+mainloop_add_data_timeout(uint32_t msec,
+			  enum timeout_result (*timeout_cb)(void *data),
+			  void *data)
+{
+	assert(timeout_cb != NULL);
+
+	return add_timeout(msec, NULL, timeout_cb, data);
 }
 
+/* Must not be called by a timeout on itself - its callback should return
+ * TIMEOUT_STOP instead */
 void mainloop_remove_timeout(struct mainloop_timeout *mt)
 {
 	assert(mt != NULL);
+	assert(mt != running_timeout);
+
+	/* Already expired, it's up to batch dispatch to free it */
+	if (mt->queued) {
+		mt->removed = true;
+		return;
+	}
 
-	remove_fd(mt->cb_data.fd);
-	(void)close(mt->cb_data.fd);
+	timer_wheel_remove(&timer_wheel, &mt->node);
 
 	free(mt);
 }
 
+void mainloop_set_timeout_priority(struct mainloop_timeout *mt,
+				   enum mainloop_priority priority)
+{
+	assert(mt != NULL);
+	assert(priority < MAINLOOP_PRIORITIES);
+
+	mt->priority = priority;
+}
+
+static bool dispatch_signal(struct callback_data *cb_data, uint32_t events,
+			    const void *buf, ssize_t nread)
+{
+	struct signalfd_siginfo info[SIGNAL_BATCH_MAX];
+	struct mainloop_signal_handler *msh =
+	    CONTAINER_OF(cb_data, struct mainloop_signal_handler, cb_data);
+
+	(void)events;
+
+	/* Signalfd only returns whole records */
+	if ((nread <= 0) || (((size_t)nread % sizeof(info[0])) != 0U)) {
+		errno = (nread < 0) ? (int)-nread : 0;
+		log_message("Error reading signal: %m\n");
+		return false;
+	}
+
+	/* Copy, as `buf` may not be properly aligned */
+	(void)memcpy(info, buf, (size_t)nread);
+	msh->callback(info, (size_t)nread / sizeof(info[0]));
+
+	return true;
+}
+
 struct mainloop_signal_handler *
 mainloop_add_signal_handler(sigset_t *mask,
-			    void (*signal_cb)(struct signalfd_siginfo *info))
+			    void (*signal_cb)(struct signalfd_siginfo *info,
+					      size_t count))
 {
 	int sig_fd;
 	struct mainloop_signal_handler *msh = NULL;
 
 	assert(mask != NULL);
 	assert(signal_cb != NULL);
-	assert(epollfd != -1);
+	assert(backend != NULL);
 
 	errno = 0;
 	msh = calloc(1, sizeof(struct mainloop_signal_handler));
@@ -261,7 +991,13 @@ mainloop_add_signal_handler(sigset_t *mask,
 		goto alloc_error;
 	}
 
-	msh->cb_data.type = CALLBACK_SIGNAL;
+	/* A single read gets all pending signals, up to SIGNAL_BATCH_MAX */
+	msh->cb_data.read_size =
+	    SIGNAL_BATCH_MAX * sizeof(struct signalfd_siginfo);
+	assert(msh->cb_data.read_size <= MAINLOOP_READ_MAX);
+	msh->cb_data.dispatch = dispatch_signal;
+	msh->cb_data.type = MAINLOOP_SOURCE_SIGNAL;
+	msh->cb_data.priority = MAINLOOP_PRIORITY_HIGH;
 	msh->callback = signal_cb;
 
 	sig_fd = signalfd(-1, mask, SFD_CLOEXEC | SFD_NONBLOCK);
@@ -271,7 +1007,7 @@ mainloop_add_signal_handler(sigset_t *mask,
 	}
 	msh->cb_data.fd = sig_fd;
 
-	if (!add_fd(sig_fd, &msh->cb_data)) {
+	if (!backend->add(&msh->cb_data, MAINLOOP_FD_READ)) {
 		goto add_fd_error;
 	}
 
@@ -286,12 +1022,112 @@ alloc_error:
 	return NULL;
 }
 
+void mainloop_set_signal_handler_priority(struct mainloop_signal_handler *msh,
+					  enum mainloop_priority priority)
+{
+	assert(msh != NULL);
+	assert(priority < MAINLOOP_PRIORITIES);
+
+	msh->cb_data.priority = priority;
+}
+
 void mainloop_remove_signal_handler(struct mainloop_signal_handler *msh)
 {
 	assert(msh != NULL);
 
-	remove_fd(msh->cb_data.fd);
+	if (backend != NULL) {
+		backend->remove(&msh->cb_data);
+	}
 	(void)close(msh->cb_data.fd);
 
-	free(msh);
+	release_source(&msh->cb_data);
+}
+
+static bool dispatch_fd(struct callback_data *cb_data, uint32_t events,
+			const void *buf, ssize_t nread)
+{
+	struct mainloop_fd_watch *mfw =
+	    CONTAINER_OF(cb_data, struct mainloop_fd_watch, cb_data);
+
+	(void)buf;
+	(void)nread;
+
+	mfw->callback(cb_data->fd, events, mfw->data);
+
+	return true;
+}
+
+/* Watches `fd` for `events` (a mask of `enum mainloop_fd_event`). Hang ups
+ * and errors are always reported. Note that `fd` is still owned by caller:
+ * mainloop will not close it */
+struct mainloop_fd_watch *
+mainloop_add_fd(int fd, uint32_t events,
+		void (*fd_cb)(int fd, uint32_t events, void *data), void *data)
+{
+	struct mainloop_fd_watch *mfw = NULL;
+
+	assert(fd > -1);
+	assert(fd_cb != NULL);
+	assert(backend != NULL);
+
+	errno = 0;
+	mfw = calloc(1, sizeof(struct mainloop_fd_watch));
+	if (mfw == NULL) {
+		log_message("Could not add fd watch: %m\n");
+		goto alloc_error;
+	}
+
+	mfw->cb_data.fd = fd;
+	mfw->cb_data.dispatch = dispatch_fd;
+	mfw->cb_data.type = MAINLOOP_SOURCE_FD;
+	mfw->cb_data.priority = MAINLOOP_PRIORITY_NORMAL;
+	mfw->events = events;
+	mfw->callback = fd_cb;
+	mfw->data = data;
+
+	if (!backend->add(&mfw->cb_data, events)) {
+		goto add_fd_error;
+	}
+
+	return mfw;
+
+add_fd_error:
+	free(mfw);
+alloc_error:
+	return NULL;
+}
+
+bool mainloop_modify_fd(struct mainloop_fd_watch *mfw, uint32_t events)
+{
+	bool result;
+
+	assert(mfw != NULL);
+	assert(backend != NULL);
+
+	result = backend->modify(&mfw->cb_data, events);
+	if (result) {
+		mfw->events = events;
+	}
+
+	return result;
+}
+
+void mainloop_remove_fd(struct mainloop_fd_watch *mfw)
+{
+	assert(mfw != NULL);
+
+	if (backend != NULL) {
+		backend->remove(&mfw->cb_data);
+	}
+
+	release_source(&mfw->cb_data);
+}
+
+void mainloop_set_fd_priority(struct mainloop_fd_watch *mfw,
+			      enum mainloop_priority priority)
+{
+	assert(mfw != NULL);
+	assert(priority < MAINLOOP_PRIORITIES);
+
+	mfw->cb_data.priority = priority;
 }
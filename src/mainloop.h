@@ -6,26 +6,97 @@
 #define MAINLOOP_HEADER_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/signalfd.h>
 
+/* Most signals read from signalfd at once, and handed to signal handler
+ * callback on a single call */
+#ifndef SIGNAL_BATCH_MAX
+#define SIGNAL_BATCH_MAX 16
+#endif
+
 enum timeout_result { TIMEOUT_STOP, TIMEOUT_CONTINUE };
+enum idle_result { IDLE_STOP, IDLE_CONTINUE };
+
+enum mainloop_fd_event {
+	MAINLOOP_FD_READ = 1 << 0,
+	MAINLOOP_FD_WRITE = 1 << 1,
+	MAINLOOP_FD_HANGUP = 1 << 2,
+	MAINLOOP_FD_ERROR = 1 << 3, /* Only reported, can't be watched */
+	MAINLOOP_FD_EDGE = 1 << 4   /* Edge triggered, instead of level */
+};
+
+enum mainloop_backend_type {
+	MAINLOOP_BACKEND_AUTO, /* io_uring if built and available, else epoll */
+	MAINLOOP_BACKEND_EPOLL,
+	MAINLOOP_BACKEND_IO_URING
+};
+
+/* Cumulative counters, for benchmarking the backends */
+struct mainloop_counters {
+	uint64_t syscalls; /* Done by mainloop on behalf of its sources */
+	uint64_t wakeups;  /* Times mainloop waited for events */
+	uint64_t events;   /* Events dispatched to sources */
+};
+
+/* Events that happen together are dispatched by priority of their sources,
+ * and on arrival order among sources with same priority. Idle callbacks always
+ * come after everything else */
+enum mainloop_priority {
+	MAINLOOP_PRIORITY_CRITICAL, /* Like feeding the watchdog */
+	MAINLOOP_PRIORITY_HIGH,     /* Default for signal handlers */
+	MAINLOOP_PRIORITY_NORMAL,   /* Default for fd watches */
+	MAINLOOP_PRIORITY_LOW,      /* Default for timeouts */
+	MAINLOOP_PRIORITIES
+};
 
 struct mainloop_timeout;
 struct mainloop_signal_handler;
+struct mainloop_fd_watch;
+struct mainloop_idle;
 
 bool mainloop_setup(void);
+bool mainloop_setup_backend(enum mainloop_backend_type type);
+const char *mainloop_backend_name(void);
+void mainloop_get_counters(struct mainloop_counters *counters);
 void mainloop_exit(void);
 bool mainloop_start(void);
 
 struct mainloop_timeout *
 mainloop_add_timeout(uint32_t msec, enum timeout_result (*timeout_cb)(void));
+struct mainloop_timeout *
+mainloop_add_data_timeout(uint32_t msec,
+			  enum timeout_result (*timeout_cb)(void *data),
+			  void *data);
 void mainloop_remove_timeout(struct mainloop_timeout *mt);
+void mainloop_set_timeout_priority(struct mainloop_timeout *mt,
+				   enum mainloop_priority priority);
 
 struct mainloop_signal_handler *
 mainloop_add_signal_handler(sigset_t *mask,
-			    void (*signal_cb)(struct signalfd_siginfo *info));
+			    void (*signal_cb)(struct signalfd_siginfo *info,
+					      size_t count));
 void mainloop_remove_signal_handler(struct mainloop_signal_handler *msh);
+void mainloop_set_signal_handler_priority(struct mainloop_signal_handler *msh,
+					  enum mainloop_priority priority);
+
+struct mainloop_fd_watch *
+mainloop_add_fd(int fd, uint32_t events,
+		void (*fd_cb)(int fd, uint32_t events, void *data), void *data);
+bool mainloop_modify_fd(struct mainloop_fd_watch *mfw, uint32_t events);
+void mainloop_remove_fd(struct mainloop_fd_watch *mfw);
+void mainloop_set_fd_priority(struct mainloop_fd_watch *mfw,
+			      enum mainloop_priority priority);
+
+struct mainloop_idle *
+mainloop_add_idle(enum idle_result (*idle_cb)(void *data), void *data);
+void mainloop_remove_idle(struct mainloop_idle *mi);
+bool mainloop_defer(void (*defer_cb)(void *data), void *data);
+
+void mainloop_set_stall_budget(uint32_t msec);
+void mainloop_dump_stats(int fd);
 
 void mainloop_set_post_iteration_callback(void (*cb)(void));
+void mainloop_request_post_iteration(void);
 
 #endif
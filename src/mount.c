@@ -15,6 +15,7 @@
 
 #include "lexer.h"
 #include "log.h"
+#include "timeline.h"
 
 static const struct mount_table {
 	const char *source;
@@ -25,6 +26,8 @@ static const struct mount_table {
 	bool fatal;
 } mount_table[] = {
     {NULL, "/sys", "sysfs", NULL, MS_NOSUID | MS_NOEXEC | MS_NODEV, true},
+    {NULL, "/sys/fs/cgroup", "cgroup2", NULL, MS_NOSUID | MS_NOEXEC | MS_NODEV,
+     false},
     {NULL, "/proc", "proc", NULL, MS_NOSUID | MS_NOEXEC | MS_NODEV, true},
     {NULL, "/dev", "devtmpfs", "mode=0755", MS_NOSUID | MS_STRICTATIME, true},
     {NULL, "/dev/pts", "devpts", "mode=0620", MS_NOSUID | MS_NOEXEC, true},
@@ -362,10 +365,16 @@ end:
 
 bool mount_mount_filesystems(void)
 {
-	bool result = true;
+	bool result;
+
+	timeline_record(TIMELINE_BEGIN, "mount-system", 0, 0);
+	result = mount_system_filesystems();
+	timeline_record(TIMELINE_END, "mount-system", 0, 0);
 
-	if (!mount_system_filesystems() || !mount_fstab_filesystems()) {
-		result = false;
+	if (result) {
+		timeline_record(TIMELINE_BEGIN, "mount-fstab", 0, 0);
+		result = mount_fstab_filesystems();
+		timeline_record(TIMELINE_END, "mount-fstab", 0, 0);
 	}
 
 	return result;
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Services with `ready=notify` option tell init they are ready by sending
+ * "READY=1" over a datagram socket they inherit, whose fd number is on
+ * NOTIFY_FD environment variable. All of them share the same socket, as
+ * kernel attaches sender credentials to each datagram. As it's created before
+ * spawn server is forked, entries spawned by server get it as well. */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "notify.h"
+
+#include "log.h"
+#include "mainloop.h"
+
+#ifndef NOTIFY_MESSAGE_MAX
+#define NOTIFY_MESSAGE_MAX 256
+#endif
+
+static int init_fd = -1;  /* Read by init */
+static int child_fd = -1; /* Written by children */
+static struct mainloop_fd_watch *notify_watch;
+static notify_ready_cb ready_cb;
+
+/* Children get their stdio on fds 0-2, which init keeps closed, so socket
+ * ends can't be there */
+static int move_above_stdio(int fd)
+{
+	int r;
+
+	if (fd > STDERR_FILENO) {
+		return fd;
+	}
+
+	errno = 0;
+	r = fcntl(fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+	if (r < 0) {
+		log_message("Couldn't safe dup file descriptor: %m\n");
+	}
+	(void)close(fd);
+
+	return r;
+}
+
+/* Message may have several `VARIABLE=value` lines, only READY=1 matters */
+static bool is_ready_message(char *message)
+{
+	char *line, *saveptr = NULL;
+
+	for (line = strtok_r(message, "\n", &saveptr); line != NULL;
+	     line = strtok_r(NULL, "\n", &saveptr)) {
+		if (strcmp(line, "READY=1") == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void notify_cb(int fd, uint32_t events, void *data)
+{
+	char buf[NOTIFY_MESSAGE_MAX + 1];
+	union {
+		struct cmsghdr cmsg;
+		char buf[CMSG_SPACE(sizeof(struct ucred))];
+	} control;
+	struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf) - 1};
+	struct msghdr msg = {.msg_iov = &iov,
+			     .msg_iovlen = 1,
+			     .msg_control = &control,
+			     .msg_controllen = sizeof(control)};
+	struct cmsghdr *cmsg;
+	struct ucred *cred = NULL;
+	ssize_t size;
+
+	(void)events;
+	(void)data;
+
+	/* Any fd sent along doesn't fit on control buffer, so it's discarded
+	 * by kernel */
+	errno = 0;
+	size = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (size < 0) {
+		if ((errno != EAGAIN) && (errno != EINTR)) {
+			log_message("Could not read readiness notification: "
+				    "%m\n");
+		}
+		return;
+	}
+	buf[size] = '\0';
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_SOCKET) &&
+		    (cmsg->cmsg_type == SCM_CREDENTIALS)) {
+			cred = (struct ucred *)CMSG_DATA(cmsg);
+		}
+	}
+
+	if (cred == NULL) {
+		log_message("Readiness notification without credentials\n");
+		return;
+	}
+
+	if (is_ready_message(buf)) {
+		ready_cb(cred->pid);
+	}
+}
+
+bool notify_start(notify_ready_cb cb)
+{
+	int fds[2], one = 1;
+
+	assert(cb != NULL);
+	assert(init_fd == -1);
+
+	errno = 0;
+	if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		log_message("Could not create readiness notification socket: "
+			    "%m\n");
+		goto err_socket;
+	}
+
+	errno = 0;
+	if (setsockopt(fds[0], SOL_SOCKET, SO_PASSCRED, &one, sizeof(one)) <
+	    0) {
+		log_message("Could not get readiness notification credentials: "
+			    "%m\n");
+		goto err_setup;
+	}
+
+	init_fd = move_above_stdio(fds[0]);
+	child_fd = move_above_stdio(fds[1]);
+	if ((init_fd < 0) || (child_fd < 0)) {
+		notify_stop();
+		return false;
+	}
+
+	notify_watch =
+	    mainloop_add_fd(init_fd, MAINLOOP_FD_READ, notify_cb, NULL);
+	if (notify_watch == NULL) {
+		log_message("Could not watch readiness notification socket\n");
+		notify_stop();
+		return false;
+	}
+
+	ready_cb = cb;
+
+	return true;
+
+err_setup:
+	(void)close(fds[0]);
+	(void)close(fds[1]);
+err_socket:
+	return false;
+}
+
+void notify_stop(void)
+{
+	if (notify_watch != NULL) {
+		mainloop_remove_fd(notify_watch);
+		notify_watch = NULL;
+	}
+
+	if (init_fd >= 0) {
+		(void)close(init_fd);
+		init_fd = -1;
+	}
+
+	if (child_fd >= 0) {
+		(void)close(child_fd);
+		child_fd = -1;
+	}
+}
+
+int notify_child_fd(void) { return child_fd; }
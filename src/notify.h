@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef NOTIFY_HEADER_
+#define NOTIFY_HEADER_
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Called on init for each readiness notification, with sender pid */
+typedef void (*notify_ready_cb)(pid_t pid);
+
+bool notify_start(notify_ready_cb cb);
+void notify_stop(void);
+/* Socket end children notify on, -1 if not started */
+int notify_child_fd(void);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#include "process-table.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+/* log2 of initial capacity */
+#ifndef PROCESS_TABLE_MIN_CAPACITY_BITS
+#define PROCESS_TABLE_MIN_CAPACITY_BITS 6
+#endif
+
+#define PROCESS_TABLE_MIN_CAPACITY                                             \
+	((size_t)1 << PROCESS_TABLE_MIN_CAPACITY_BITS)
+
+/* Fibonacci hashing: top bits of the product depend on all pid bits, so
+ * pids equal modulo capacity still get different slots */
+static size_t slot_of(const struct process_table *pt, pid_t pid)
+{
+	return (size_t)(((uint32_t)pid * 2654435769U) >>
+			(32U - pt->capacity_bits));
+}
+
+static size_t next_slot(const struct process_table *pt, size_t slot)
+{
+	return (slot + 1U) & (pt->capacity - 1U);
+}
+
+static void insert_slot(struct process_table *pt, struct process *p)
+{
+	size_t slot = slot_of(pt, p->pid);
+
+	while (pt->slots[slot] != NULL) {
+		slot = next_slot(pt, slot);
+	}
+	pt->slots[slot] = p;
+}
+
+static bool grow(struct process_table *pt)
+{
+	size_t i, old_capacity = pt->capacity;
+	struct process **old_slots = pt->slots;
+	struct process **slots;
+
+	slots = calloc(old_capacity * 2U, sizeof(struct process *));
+	if (slots == NULL) {
+		log_message("Could not grow process table: %m\n");
+		return false;
+	}
+
+	pt->slots = slots;
+	pt->capacity = old_capacity * 2U;
+	pt->capacity_bits++;
+
+	for (i = 0; i < old_capacity; i++) {
+		if (old_slots[i] != NULL) {
+			insert_slot(pt, old_slots[i]);
+		}
+	}
+
+	free(old_slots);
+
+	return true;
+}
+
+bool process_table_init(struct process_table *pt)
+{
+	size_t i;
+
+	assert(pt != NULL);
+
+	pt->slots = calloc(PROCESS_TABLE_MIN_CAPACITY, sizeof(struct process *));
+	if (pt->slots == NULL) {
+		log_message("Could not allocate process table: %m\n");
+		return false;
+	}
+
+	pt->capacity = PROCESS_TABLE_MIN_CAPACITY;
+	pt->capacity_bits = PROCESS_TABLE_MIN_CAPACITY_BITS;
+	pt->count = 0;
+	for (i = 0; i < PROCESS_KINDS; i++) {
+		pt->lists[i] = NULL;
+		pt->list_count[i] = 0;
+	}
+
+	return true;
+}
+
+/* Frees all processes still on table */
+void process_table_free(struct process_table *pt)
+{
+	size_t i;
+
+	assert(pt != NULL);
+
+	for (i = 0; i < pt->capacity; i++) {
+		free(pt->slots[i]);
+	}
+	free(pt->slots);
+
+	pt->slots = NULL;
+	pt->capacity = 0;
+	pt->capacity_bits = 0;
+	pt->count = 0;
+	for (i = 0; i < PROCESS_KINDS; i++) {
+		pt->lists[i] = NULL;
+		pt->list_count[i] = 0;
+	}
+}
+
+/* Fails only if table is full and can't grow. If growing fails earlier,
+ * table simply gets more crowded */
+bool process_table_add(struct process_table *pt, struct process *p)
+{
+	assert(pt != NULL);
+	assert(p != NULL);
+	assert(p->pprev == NULL);
+	assert(p->kind < PROCESS_KINDS);
+	assert(process_table_find(pt, p->pid) == NULL);
+
+	if (((pt->count + 1U) * 2U) > pt->capacity) {
+		if (!grow(pt) && ((pt->count + 1U) == pt->capacity)) {
+			return false;
+		}
+	}
+
+	insert_slot(pt, p);
+	pt->count++;
+
+	p->next = pt->lists[p->kind];
+	if (p->next != NULL) {
+		p->next->pprev = &p->next;
+	}
+	p->pprev = &pt->lists[p->kind];
+	pt->lists[p->kind] = p;
+	pt->list_count[p->kind]++;
+
+	return true;
+}
+
+struct process *process_table_find(const struct process_table *pt, pid_t pid)
+{
+	size_t slot;
+
+	assert(pt != NULL);
+
+	slot = slot_of(pt, pid);
+	while (pt->slots[slot] != NULL) {
+		if (pt->slots[slot]->pid == pid) {
+			return pt->slots[slot];
+		}
+		slot = next_slot(pt, slot);
+	}
+
+	return NULL;
+}
+
+/* Backward shift deletion: entries after removed one on its probe sequence
+ * are moved back, so no tombstones are needed. Doesn't free `p` */
+void process_table_remove(struct process_table *pt, struct process *p)
+{
+	size_t hole, slot;
+
+	assert(pt != NULL);
+	assert(p != NULL);
+	assert(p->pprev != NULL);
+
+	hole = slot_of(pt, p->pid);
+	while (pt->slots[hole] != p) {
+		assert(pt->slots[hole] != NULL);
+		hole = next_slot(pt, hole);
+	}
+
+	slot = next_slot(pt, hole);
+	while (pt->slots[slot] != NULL) {
+		size_t home = slot_of(pt, pt->slots[slot]->pid);
+
+		/* Entry can fill the hole if its home is not cyclically in
+		 * (hole, slot] - otherwise it'd become unreachable */
+		if (((slot - home) & (pt->capacity - 1U)) >=
+		    ((slot - hole) & (pt->capacity - 1U))) {
+			pt->slots[hole] = pt->slots[slot];
+			hole = slot;
+		}
+		slot = next_slot(pt, slot);
+	}
+	pt->slots[hole] = NULL;
+	pt->count--;
+
+	*p->pprev = p->next;
+	if (p->next != NULL) {
+		p->next->pprev = p->pprev;
+	}
+	p->next = NULL;
+	p->pprev = NULL;
+	pt->list_count[p->kind]--;
+}
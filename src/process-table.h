@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef PROCESS_TABLE_HEADER_
+#define PROCESS_TABLE_HEADER_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct inittab_entry;
+struct mainloop_fd_watch;
+struct mainloop_timeout;
+
+/* Running processes are also on a list of their kind, so walks like
+ * terminating all processes don't need to skip the safe mode placeholder */
+enum process_kind {
+	PROCESS_KIND_SAFE_MODE,
+	PROCESS_KIND_ONE_SHOT,
+	PROCESS_KIND_SERVICE,
+	PROCESS_KINDS
+};
+
+struct process {
+	struct process *next;   /* On list of its kind */
+	struct process **pprev; /* NULL if not on table */
+	const struct inittab_entry *config;
+	/* On list of its entry processes, kept by init. NULL if not on it */
+	struct process *entry_next;
+	struct process **entry_pprev;
+	pid_t pid;
+	int pidfd; /* -1 if not available */
+	struct mainloop_fd_watch *watch;
+	enum process_kind kind;
+	/* Init waits for it while its entry is started: one-shot not exited,
+	 * or service not ready yet */
+	bool pending;
+	struct mainloop_timeout *deadline; /* To stop being pending */
+	bool deadline_killed; /* Killed by init for missing its deadline */
+	uint32_t attempt;     /* Retries of its entry before it */
+};
+
+/* Hash table keyed by pid, using open addressing with linear probing. Never
+ * more than half full, so probes are short. */
+struct process_table {
+	struct process **slots;
+	size_t capacity; /* Power of two */
+	unsigned int capacity_bits; /* log2(capacity) */
+	size_t count;
+	struct process *lists[PROCESS_KINDS];
+	size_t list_count[PROCESS_KINDS];
+};
+
+bool process_table_init(struct process_table *pt);
+void process_table_free(struct process_table *pt);
+bool process_table_add(struct process_table *pt, struct process *p);
+struct process *process_table_find(const struct process_table *pt, pid_t pid);
+void process_table_remove(struct process_table *pt, struct process *p);
+
+static inline struct process *
+process_table_first(const struct process_table *pt, enum process_kind kind)
+{
+	return pt->lists[kind];
+}
+
+static inline size_t process_table_count(const struct process_table *pt,
+					 enum process_kind kind)
+{
+	return pt->list_count[kind];
+}
+
+#endif
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Spawn server is a process forked by init right after reading inittab, that
+ * spawns entries on init behalf, so init can go back to its mainloop while
+ * they are started. Init sends batches of entries over a socketpair and
+ * server answers each batch with the pids, in the same order. As server is a
+ * fork of init, entries are sent as pointers - inittab is never changed after
+ * read. Children are spawned with CLONE_PARENT, so they are init children,
+ * reaped and supervised by it as if init spawned them itself. */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "spawn-server.h"
+
+#include "inittab.h"
+#include "log.h"
+#include "mainloop.h"
+#include "notify.h"
+#include "spawn.h"
+
+#ifdef COMPILING_COVERAGE
+extern void __gcov_flush(void);
+#endif
+
+/* Batches sent to server, waiting for its answer */
+struct spawn_batch {
+	struct spawn_batch *next;
+	size_t count;
+	const struct inittab_entry *entries[SPAWN_BATCH_MAX];
+};
+
+static int server_fd = -1;
+static struct mainloop_fd_watch *server_watch;
+static spawn_server_cb spawned_cb;
+static struct spawn_batch *batches;
+static struct spawn_batch **batches_tail = &batches;
+
+/* Server shouldn't keep init files open, like watchdog or safe mode pipe.
+ * Readiness notification socket is passed on to its children */
+static void close_inherited_fds(int keep)
+{
+	long max = sysconf(_SC_OPEN_MAX);
+	int fd, log = log_fd(), notify = notify_child_fd();
+
+	if (max < 0) {
+		max = 1024;
+	}
+
+	for (fd = 0; fd < max; fd++) {
+		if ((fd != keep) && (fd != log) && (fd != notify)) {
+			(void)close(fd);
+		}
+	}
+}
+
+static pid_t spawn_entry(const struct inittab_entry *entry)
+{
+	struct spawn_attr attr;
+	pid_t pid;
+
+	if (!spawn_attr_init(&attr, &entry->cmd, entry->exec_path,
+			     entry->ctty_path, &entry->cpus)) {
+		return -1;
+	}
+
+	spawn_attr_set_sched(&attr, &entry->sched);
+	spawn_attr_set_ioprio(&attr, &entry->ioprio);
+	spawn_attr_set_mempolicy(&attr, &entry->mempolicy);
+	spawn_attr_set_rlimits(&attr, entry->rlimits, entry->rlimit_count);
+
+	/* Not fatal, it just runs on init cgroup */
+	if (entry->cgroup[0] != '\0') {
+		(void)spawn_attr_set_cgroup(&attr, entry->cgroup);
+	}
+
+	if (entry->ready_notify && (notify_child_fd() >= 0) &&
+	    !spawn_attr_set_notify(&attr, notify_child_fd())) {
+		spawn_attr_destroy(&attr);
+		return -1;
+	}
+
+	attr.sibling = true;
+	pid = spawn(&attr);
+	spawn_attr_destroy(&attr);
+
+	log_message("spawn server result for '%s': %d\n", entry->process_name,
+		    pid);
+
+	return pid;
+}
+
+/* Runs on server process, never returns */
+__attribute__((noreturn)) static void server_main(int fd)
+{
+	const struct inittab_entry *entries[SPAWN_BATCH_MAX];
+	pid_t pids[SPAWN_BATCH_MAX];
+	int result = EXIT_FAILURE;
+
+	close_inherited_fds(fd);
+
+	while (true) {
+		ssize_t size;
+		size_t i, count;
+
+		errno = 0;
+		size = recv(fd, entries, sizeof(entries), 0);
+		if (size == 0) {
+			/* Init is done with us */
+			result = EXIT_SUCCESS;
+			break;
+		} else if (size < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			log_message("Spawn server could not read request: %m\n");
+			break;
+		}
+
+		count = (size_t)size / sizeof(entries[0]);
+		for (i = 0; i < count; i++) {
+			pids[i] = spawn_entry(entries[i]);
+		}
+
+		errno = 0;
+		if (send(fd, pids, count * sizeof(pids[0]), MSG_NOSIGNAL) < 0) {
+			log_message("Spawn server could not answer: %m\n");
+			break;
+		}
+	}
+
+#ifdef COMPILING_COVERAGE
+	__gcov_flush();
+	sync();
+#endif
+	_exit(result);
+}
+
+/* Entries of batches not answered are reported as not spawned - server may
+ * have spawned some of them, but init has no way to know */
+static void server_lost(void)
+{
+	struct spawn_batch *batch;
+	size_t i;
+
+	log_message("Spawn server lost, init will spawn entries itself\n");
+
+	if (server_watch != NULL) {
+		mainloop_remove_fd(server_watch);
+		server_watch = NULL;
+	}
+
+	if (server_fd >= 0) {
+		(void)close(server_fd);
+		server_fd = -1;
+	}
+
+	while ((batch = batches) != NULL) {
+		batches = batch->next;
+		for (i = 0; i < batch->count; i++) {
+			spawned_cb(batch->entries[i], -1);
+		}
+		free(batch);
+	}
+	batches_tail = &batches;
+}
+
+static void server_answer_cb(int fd, uint32_t events, void *data)
+{
+	pid_t pids[SPAWN_BATCH_MAX];
+	struct spawn_batch *batch;
+	ssize_t size;
+	size_t i, count;
+
+	(void)data;
+
+	if ((events & MAINLOOP_FD_READ) == 0) {
+		server_lost();
+		return;
+	}
+
+	errno = 0;
+	size = recv(fd, pids, sizeof(pids), MSG_DONTWAIT);
+	if (size < 0) {
+		if ((errno == EAGAIN) || (errno == EINTR)) {
+			return;
+		}
+		log_message("Could not read spawn server answer: %m\n");
+		server_lost();
+		return;
+	} else if ((size == 0) || (batches == NULL)) {
+		server_lost();
+		return;
+	}
+
+	/* Answers come in the same order as requests */
+	batch = batches;
+	batches = batch->next;
+	if (batches == NULL) {
+		batches_tail = &batches;
+	}
+
+	count = (size_t)size / sizeof(pids[0]);
+	for (i = 0; i < batch->count; i++) {
+		spawned_cb(batch->entries[i], (i < count) ? pids[i] : -1);
+	}
+
+	free(batch);
+}
+
+/* Expects inittab to be read already */
+bool spawn_server_start(spawn_server_cb cb)
+{
+	int fds[2];
+	pid_t pid;
+
+	assert(cb != NULL);
+	assert(server_fd == -1);
+
+	errno = 0;
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+		log_message("Could not create spawn server socket: %m\n");
+		goto err_socket;
+	}
+
+	errno = 0;
+	pid = fork();
+	if (pid < 0) {
+		log_message("Could not fork spawn server: %m\n");
+		goto err_fork;
+	} else if (pid == 0) {
+		server_main(fds[1]);
+	}
+
+	(void)close(fds[1]);
+	server_fd = fds[0];
+	spawned_cb = cb;
+
+	server_watch = mainloop_add_fd(server_fd, MAINLOOP_FD_READ,
+				       server_answer_cb, NULL);
+	if (server_watch == NULL) {
+		log_message("Could not watch spawn server socket\n");
+		/* Server exits once its socket is closed */
+		(void)close(server_fd);
+		server_fd = -1;
+		return false;
+	}
+
+	/* New processes must be tracked before their exit is handled */
+	mainloop_set_fd_priority(server_watch, MAINLOOP_PRIORITY_HIGH);
+
+	log_message("Spawn server started, pid %d\n", pid);
+
+	return true;
+
+err_fork:
+	(void)close(fds[0]);
+	(void)close(fds[1]);
+err_socket:
+	return false;
+}
+
+void spawn_server_stop(void)
+{
+	struct spawn_batch *batch;
+
+	if (server_watch != NULL) {
+		mainloop_remove_fd(server_watch);
+		server_watch = NULL;
+	}
+
+	if (server_fd >= 0) {
+		(void)close(server_fd);
+		server_fd = -1;
+	}
+
+	while ((batch = batches) != NULL) {
+		batches = batch->next;
+		free(batch);
+	}
+	batches_tail = &batches;
+}
+
+bool spawn_server_busy(void) { return batches != NULL; }
+
+bool spawn_server_request(const struct inittab_entry *const *entries,
+			  size_t count)
+{
+	struct spawn_batch *batch;
+	size_t i;
+
+	assert(entries != NULL);
+	assert(count <= SPAWN_BATCH_MAX);
+
+	if ((server_fd < 0) || (count == 0)) {
+		return false;
+	}
+
+	batch = calloc(1, sizeof(struct spawn_batch));
+	if (batch == NULL) {
+		log_message("Could not allocate spawn server request: %m\n");
+		return false;
+	}
+
+	for (i = 0; i < count; i++) {
+		batch->entries[i] = entries[i];
+	}
+	batch->count = count;
+
+	errno = 0;
+	if (send(server_fd, batch->entries, count * sizeof(entries[0]),
+		 MSG_NOSIGNAL) < 0) {
+		log_message("Could not send spawn server request: %m\n");
+		free(batch);
+		server_lost();
+		return false;
+	}
+
+	*batches_tail = batch;
+	batches_tail = &batch->next;
+
+	return true;
+}
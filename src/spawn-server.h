@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef SPAWN_SERVER_HEADER_
+#define SPAWN_SERVER_HEADER_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifndef SPAWN_BATCH_MAX
+#define SPAWN_BATCH_MAX 64
+#endif
+
+struct inittab_entry;
+
+/* Called on init for each requested entry, once the server has spawned it.
+ * `pid` is -1 if it couldn't be spawned */
+typedef void (*spawn_server_cb)(const struct inittab_entry *entry, pid_t pid);
+
+#ifdef SPAWN_SERVER
+
+bool spawn_server_start(spawn_server_cb cb);
+void spawn_server_stop(void);
+bool spawn_server_busy(void);
+/* Up to SPAWN_BATCH_MAX entries. If false, none will be spawned by server */
+bool spawn_server_request(const struct inittab_entry *const *entries,
+			  size_t count);
+
+#else
+
+static inline bool spawn_server_start(spawn_server_cb cb)
+{
+	(void)cb;
+	return false;
+}
+
+static inline void spawn_server_stop(void) {}
+
+static inline bool spawn_server_busy(void) { return false; }
+
+static inline bool
+spawn_server_request(const struct inittab_entry *const *entries, size_t count)
+{
+	(void)entries;
+	(void)count;
+	return false;
+}
+
+#endif
+
+#endif
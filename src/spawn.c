@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Children are created with clone(CLONE_VM | CLONE_VFORK): they share init
+ * address space until exec, so spawn cost doesn't grow with init memory and
+ * page tables as fork() does. Init is suspended meanwhile, and the child
+ * runs on a stack of its own. As memory is shared, the child must not touch
+ * anything but what's on its stack and the `spawn_child` it reports to - no
+ * allocation, no logging. */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "spawn.h"
+
+#include "console.h"
+#include "log.h"
+
+#ifndef SPAWN_STACK_SIZE
+#define SPAWN_STACK_SIZE (64 * 1024)
+#endif
+
+/* Steps done by child, so init can tell which one failed */
+enum spawn_step {
+	SPAWN_STEP_CGROUP,
+	SPAWN_STEP_SETSID,
+	SPAWN_STEP_AFFINITY,
+	SPAWN_STEP_SCHED,
+	SPAWN_STEP_IOPRIO,
+	SPAWN_STEP_MEMPOLICY,
+	SPAWN_STEP_RLIMIT,
+	SPAWN_STEP_STDIO,
+	SPAWN_STEP_CTTY,
+	SPAWN_STEP_NOTIFY,
+	SPAWN_STEP_EXEC
+};
+
+static const char *const step_names[] = {
+    [SPAWN_STEP_CGROUP] = "set cgroup of",
+    [SPAWN_STEP_SETSID] = "make session leader of",
+    [SPAWN_STEP_AFFINITY] = "set CPU affinity of",
+    [SPAWN_STEP_SCHED] = "set scheduling policy of",
+    [SPAWN_STEP_IOPRIO] = "set I/O priority of",
+    [SPAWN_STEP_MEMPOLICY] = "set memory policy of",
+    [SPAWN_STEP_RLIMIT] = "set resource limits of",
+    [SPAWN_STEP_STDIO] = "set up stdio of",
+    [SPAWN_STEP_CTTY] = "set up controlling terminal of",
+    [SPAWN_STEP_NOTIFY] = "pass notification fd to",
+    [SPAWN_STEP_EXEC] = "exec"};
+
+struct spawn_child {
+	const struct spawn_attr *attr;
+	enum spawn_step step;
+	int error; /* Set by child if it failed */
+};
+
+/* Init is suspended until the child execs or exits, so one stack is enough */
+static char child_stack[SPAWN_STACK_SIZE] __attribute__((aligned(16)));
+
+/* Fds below STDERR_FILENO would be closed when child sets up its stdio (init
+ * runs with standard fds closed). Always returns a new fd, as dup2() to
+ * itself would keep close on exec */
+static int dup_above_stdio(int fd)
+{
+	int r;
+
+	errno = 0;
+	r = fcntl(fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+	if (r < 0) {
+		log_message("Couldn't safe dup file descriptor: %m\n");
+	}
+
+	return r;
+}
+
+static bool setup_stdio_fds(struct spawn_attr *attr)
+{
+	int null_fd;
+
+	errno = 0;
+	null_fd = open("/dev/null", O_RDONLY | O_NOCTTY | O_CLOEXEC);
+	if (null_fd == -1) {
+		log_message("Could not open /dev/null: %m\n");
+		goto err_open_null;
+	}
+
+	attr->stdin_fd = dup_above_stdio(null_fd);
+	(void)close(null_fd);
+	if (attr->stdin_fd == -1) {
+		goto err_open_null;
+	}
+
+	if (log_fd() == -1) {
+		log_message("Could not open logfile: %m\n");
+		goto err_open_out;
+	}
+
+	attr->stdout_fd = dup_above_stdio(log_fd());
+	if (attr->stdout_fd == -1) {
+		goto err_open_out;
+	}
+
+	return true;
+
+err_open_out:
+	(void)close(attr->stdin_fd);
+	attr->stdin_fd = -1;
+err_open_null:
+	return false;
+}
+
+static bool setup_stty_fds(struct spawn_attr *attr, const char *terminal)
+{
+	int tty;
+
+	tty = open_console(terminal, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (tty == -1) {
+		log_message("Could not open terminal for child process\n");
+		goto err_open;
+	}
+
+	attr->stdin_fd = dup_above_stdio(tty);
+	(void)close(tty);
+	if (attr->stdin_fd == -1) {
+		goto err_open;
+	}
+
+	if (!reset_console(attr->stdin_fd)) {
+		goto err_console;
+	}
+
+	/* Same open file description, child dup2()s it on all stdio fds */
+	attr->stdout_fd = dup_above_stdio(attr->stdin_fd);
+	if (attr->stdout_fd == -1) {
+		goto err_console;
+	}
+
+	attr->ctty = true;
+
+	return true;
+
+err_console:
+	(void)close(attr->stdin_fd);
+	attr->stdin_fd = -1;
+err_open:
+	return false;
+}
+
+/* cmd and exec_path must outlive attr. No affinity is set if `cpus` is NULL
+ * or empty */
+bool spawn_attr_init(struct spawn_attr *attr,
+		     const struct cmdline_contents *cmd, const char *exec_path,
+		     const char *console, const cpu_set_t *cpus)
+{
+	assert(attr != NULL);
+	assert(cmd != NULL);
+	assert(cmd->args[0] != NULL);
+	assert(exec_path != NULL);
+	assert(console != NULL);
+
+	*attr = (struct spawn_attr){
+	    .cmd = cmd,
+	    .exec_path = exec_path,
+	    .stdin_fd = -1,
+	    .stdout_fd = -1,
+	    .notify_fd = -1,
+	    .cgroup_fd = -1};
+
+	/* Set CPU affinity if defined on inittab */
+	if ((cpus != NULL) && (CPU_COUNT(cpus) > 0)) {
+		attr->affinity = *cpus;
+		attr->set_affinity = true;
+	}
+
+	/* Configure terminal for child */
+	if (console[0] != '\0') {
+		if (!setup_stty_fds(attr, console)) {
+			log_message(
+			    "Could not setup tty '%s' for process '%s'\n",
+			    console, cmd->args[0]);
+			return false;
+		}
+	} else if (!setup_stdio_fds(attr)) {
+		return false;
+	}
+
+	return true;
+}
+
+void spawn_attr_destroy(struct spawn_attr *attr)
+{
+	assert(attr != NULL);
+
+	if (attr->stdin_fd != -1) {
+		(void)close(attr->stdin_fd);
+		attr->stdin_fd = -1;
+	}
+
+	if (attr->stdout_fd != -1) {
+		(void)close(attr->stdout_fd);
+		attr->stdout_fd = -1;
+	}
+
+	if (attr->cgroup_fd != -1) {
+		(void)close(attr->cgroup_fd);
+		attr->cgroup_fd = -1;
+	}
+}
+
+bool spawn_attr_set_notify(struct spawn_attr *attr, int fd)
+{
+	size_t i;
+
+	assert(attr != NULL);
+	assert(fd > STDERR_FILENO);
+
+	for (i = 0; (i < ENV_MAX) && (attr->cmd->env[i] != NULL); i++) {
+		attr->env[i] = attr->cmd->env[i];
+	}
+
+	if (i == ENV_MAX) {
+		log_message("No room for NOTIFY_FD on process '%s' "
+			    "environment\n",
+			    attr->cmd->args[0]);
+		return false;
+	}
+
+	(void)snprintf(attr->notify_env, sizeof(attr->notify_env),
+		       "NOTIFY_FD=%d", fd);
+	attr->env[i++] = attr->notify_env;
+	attr->env[i] = NULL;
+	attr->notify_fd = fd;
+
+	return true;
+}
+
+void spawn_attr_set_sched(struct spawn_attr *attr,
+			  const struct spawn_sched *sched)
+{
+	assert(attr != NULL);
+	assert(sched != NULL);
+
+	if (sched->policy == SCHED_OTHER) {
+		attr->set_sched = false;
+		return;
+	}
+
+	attr->sched = (struct spawn_sched_attr){
+	    .size = sizeof(attr->sched),
+	    .policy = (uint32_t)sched->policy,
+	    .priority = sched->priority,
+	    .runtime = (uint64_t)sched->runtime_us * 1000U,
+	    .deadline = (uint64_t)sched->deadline_us * 1000U,
+	    .period = (uint64_t)sched->period_us * 1000U};
+	attr->set_sched = true;
+}
+
+void spawn_attr_set_ioprio(struct spawn_attr *attr,
+			   const struct spawn_ioprio *ioprio)
+{
+	assert(attr != NULL);
+	assert(ioprio != NULL);
+
+	if (ioprio->class == SPAWN_IOPRIO_CLASS_NONE) {
+		attr->ioprio = 0;
+		return;
+	}
+
+	attr->ioprio = ((int)ioprio->class << SPAWN_IOPRIO_CLASS_SHIFT) |
+		       (int)ioprio->level;
+}
+
+void spawn_attr_set_mempolicy(struct spawn_attr *attr,
+			      const struct spawn_mempolicy *mempolicy)
+{
+	assert(attr != NULL);
+	assert(mempolicy != NULL);
+
+	attr->mempolicy = (mempolicy->mode != MPOL_DEFAULT) ? mempolicy : NULL;
+}
+
+void spawn_attr_set_rlimits(struct spawn_attr *attr,
+			    const struct spawn_rlimit *rlimits, size_t count)
+{
+	assert(attr != NULL);
+	assert((rlimits != NULL) || (count == 0));
+
+	attr->rlimits = rlimits;
+	attr->rlimit_count = count;
+}
+
+/* Child moves itself to the cgroup, see child_main() */
+bool spawn_attr_set_cgroup(struct spawn_attr *attr, const char *dir)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	assert(attr != NULL);
+	assert(dir != NULL);
+
+	(void)snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+
+	errno = 0;
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		log_message("Could not open cgroup of process '%s': %m\n",
+			    attr->cmd->args[0]);
+		return false;
+	}
+
+	attr->cgroup_fd = dup_above_stdio(fd);
+	(void)close(fd);
+
+	return attr->cgroup_fd != -1;
+}
+
+/* Runs on child, sharing init memory. Only returns if something failed */
+static int child_main(void *data)
+{
+	struct spawn_child *child = data;
+	const struct spawn_attr *attr = child->attr;
+	const char *const *env = attr->cmd->env;
+	sigset_t mask;
+	size_t i;
+
+	/* Writing 0 moves the writer. Joining before anything else, every
+	 * later step - and exec - is accounted to the cgroup */
+	if (attr->cgroup_fd >= 0) {
+		child->step = SPAWN_STEP_CGROUP;
+		if (write(attr->cgroup_fd, "0", 1) == -1) {
+			goto fail;
+		}
+	}
+
+	/* Become a session leader */
+	child->step = SPAWN_STEP_SETSID;
+	if (setsid() == -1) {
+		goto fail;
+	}
+
+	if (attr->set_affinity) {
+		child->step = SPAWN_STEP_AFFINITY;
+		if (sched_setaffinity(0, sizeof(attr->affinity),
+				      &attr->affinity) == -1) {
+			goto fail;
+		}
+	}
+
+	if (attr->set_sched) {
+		child->step = SPAWN_STEP_SCHED;
+		if (syscall(SYS_sched_setattr, 0, &attr->sched, 0) == -1) {
+			goto fail;
+		}
+	}
+
+	/* Set after scheduling policy, as kernel derives I/O priority from
+	 * it until one is set */
+	if (attr->ioprio != 0) {
+		child->step = SPAWN_STEP_IOPRIO;
+		if (syscall(SYS_ioprio_set, SPAWN_IOPRIO_WHO_PROCESS, 0,
+			    attr->ioprio) == -1) {
+			goto fail;
+		}
+	}
+
+	/* Memory policy is kept across exec. Kernel ignores the last bit of
+	 * node count */
+	if (attr->mempolicy != NULL) {
+		child->step = SPAWN_STEP_MEMPOLICY;
+		if (syscall(SYS_set_mempolicy, attr->mempolicy->mode,
+			    attr->mempolicy->nodes, SPAWN_NODES_MAX + 1) == -1) {
+			goto fail;
+		}
+	}
+
+	child->step = SPAWN_STEP_RLIMIT;
+	for (i = 0; i < attr->rlimit_count; i++) {
+		if (prlimit(0, attr->rlimits[i].resource,
+			    &attr->rlimits[i].limit, NULL) == -1) {
+			goto fail;
+		}
+	}
+
+	child->step = SPAWN_STEP_STDIO;
+	if ((dup2(attr->stdin_fd, STDIN_FILENO) == -1) ||
+	    (dup2(attr->stdout_fd, STDOUT_FILENO) == -1) ||
+	    (dup2(attr->stdout_fd, STDERR_FILENO) == -1)) {
+		goto fail;
+	}
+
+	/* Give a controlling terminal for the process */
+	if (attr->ctty) {
+		child->step = SPAWN_STEP_CTTY;
+		if (ioctl(STDIN_FILENO, TIOCSCTTY, 0) == -1) {
+			goto fail;
+		}
+	}
+
+	/* Child has its own fd table, init copy stays close on exec */
+	if (attr->notify_fd >= 0) {
+		child->step = SPAWN_STEP_NOTIFY;
+		if (fcntl(attr->notify_fd, F_SETFD, 0) == -1) {
+			goto fail;
+		}
+		env = attr->env;
+	}
+
+	/* Signals were all blocked by init around clone */
+	(void)sigemptyset(&mask);
+	(void)sigprocmask(SIG_SETMASK, &mask, NULL);
+
+	/* No __gcov_flush() here: counters are init's own, it flushes them */
+	child->step = SPAWN_STEP_EXEC;
+	if (attr->exec_path[0] != '\0') {
+		(void)execve(attr->exec_path, (char *const *)attr->cmd->args,
+			     (char *const *)env);
+	} else {
+		(void)execvpe(attr->cmd->args[0],
+			      (char *const *)attr->cmd->args,
+			      (char *const *)env);
+	}
+
+fail:
+	child->error = errno;
+	_exit(1);
+}
+
+/* Expects SIGCHLD to be disabled when called. Failures on child are reported
+ * here - child is then reaped and -1 returned */
+pid_t spawn(const struct spawn_attr *attr)
+{
+	struct spawn_child child = {.attr = attr};
+	sigset_t all, old;
+	int flags = CLONE_VM | CLONE_VFORK | SIGCHLD;
+	pid_t pid;
+	int r;
+
+	assert(attr != NULL);
+	assert(attr->cmd->args[0] != NULL);
+
+	/* No signal may be handled on child while it shares init memory */
+	r = sigfillset(&all);
+	assert(r == 0);
+	r = sigprocmask(SIG_SETMASK, &all, &old);
+	assert(r == 0);
+
+	if (attr->sibling) {
+		flags |= CLONE_PARENT;
+	}
+
+	errno = 0;
+	pid = clone(child_main, child_stack + sizeof(child_stack), flags,
+		    &child);
+	if (pid < 0) {
+		log_message("Could not clone process '%s': %m\n",
+			    attr->cmd->args[0]);
+	}
+
+	r = sigprocmask(SIG_SETMASK, &old, NULL);
+	assert(r == 0);
+
+	if ((pid > 0) && (child.error != 0)) {
+		/* Child has called _exit() already. A sibling is reaped by our
+		 * parent */
+		if (!attr->sibling) {
+			(void)waitpid(pid, NULL, 0);
+		}
+
+		errno = child.error;
+		log_message("Could not %s process '%s': %m\n",
+			    step_names[child.step], attr->cmd->args[0]);
+		pid = -1;
+	}
+
+	return pid;
+}
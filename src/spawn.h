@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef SPAWN_HEADER_
+#define SPAWN_HEADER_
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "cmdline.h"
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+/* Scheduling policy of a child, see sched(7). With SCHED_OTHER it keeps the
+ * one inherited from init */
+struct spawn_sched {
+	int policy;
+	uint32_t priority; /* SCHED_FIFO and SCHED_RR, 1 to 99 */
+	/* SCHED_DEADLINE, in microseconds. No period means same as deadline */
+	uint32_t runtime_us;
+	uint32_t deadline_us;
+	uint32_t period_us;
+};
+
+#ifndef SPAWN_NODES_MAX
+#define SPAWN_NODES_MAX 1024
+#endif
+
+#define SPAWN_NODE_BITS (8U * sizeof(unsigned long))
+
+/* Memory policy of a child, see set_mempolicy(2). With MPOL_DEFAULT it keeps
+ * the one inherited from init */
+struct spawn_mempolicy {
+	int mode;
+	unsigned long nodes[SPAWN_NODES_MAX / SPAWN_NODE_BITS];
+};
+
+/* I/O scheduling classes, see ioprio_set(2). Libc has no ioprio_set() nor
+ * its constants */
+enum spawn_ioprio_class {
+	SPAWN_IOPRIO_CLASS_NONE,
+	SPAWN_IOPRIO_CLASS_RT,
+	SPAWN_IOPRIO_CLASS_BE,
+	SPAWN_IOPRIO_CLASS_IDLE
+};
+
+#define SPAWN_IOPRIO_WHO_PROCESS 1
+#define SPAWN_IOPRIO_CLASS_SHIFT 13
+#define SPAWN_IOPRIO_LEVEL_MAX 7
+#define SPAWN_IOPRIO_LEVEL_DEFAULT 4
+
+/* I/O priority of a child. With SPAWN_IOPRIO_CLASS_NONE it keeps the one
+ * inherited from init */
+struct spawn_ioprio {
+	enum spawn_ioprio_class class;
+	uint32_t level; /* 0, highest, to 7. Not used by idle class */
+};
+
+/* A resource limit of a child, see getrlimit(2) */
+struct spawn_rlimit {
+	int resource;
+	struct rlimit limit;
+};
+
+/* Kernel `struct sched_attr`, first version. Libc has no sched_setattr() */
+struct spawn_sched_attr {
+	uint32_t size;
+	uint32_t policy;
+	uint64_t flags;
+	int32_t nice;
+	uint32_t priority;
+	uint64_t runtime;  /* Nanoseconds */
+	uint64_t deadline; /* Nanoseconds */
+	uint64_t period;   /* Nanoseconds */
+};
+
+/* Everything a child needs is prepared by init beforehand, so that between
+ * clone and exec the child only does a handful of syscalls */
+struct spawn_attr {
+	const struct cmdline_contents *cmd;
+	const char *exec_path; /* If empty, cmd program is searched on PATH */
+	int stdin_fd;  /* Above STDERR_FILENO and close on exec */
+	int stdout_fd; /* Also used for stderr */
+	bool ctty;     /* Make stdin the controlling terminal */
+	bool set_affinity;
+	cpu_set_t affinity;
+	bool set_sched;
+	struct spawn_sched_attr sched;
+	int ioprio; /* As ioprio_set() takes it. 0 if none */
+	/* cgroup.procs of the cgroup child joins, close on exec. -1 if none */
+	int cgroup_fd;
+	const struct spawn_rlimit *rlimits;
+	size_t rlimit_count;
+	const struct spawn_mempolicy *mempolicy; /* NULL if none */
+	/* Child is made a child of our parent, which reaps it (CLONE_PARENT) */
+	bool sibling;
+	/* Readiness notification fd, kept open on child. -1 if none */
+	int notify_fd;
+	/* cmd environment plus NOTIFY_FD variable, if notify_fd is set */
+	const char *env[ENV_MAX + 1];
+	char notify_env[32];
+};
+
+bool spawn_attr_init(struct spawn_attr *attr,
+		     const struct cmdline_contents *cmd, const char *exec_path,
+		     const char *console, const cpu_set_t *cpus);
+void spawn_attr_destroy(struct spawn_attr *attr);
+/* `fd` must be above STDERR_FILENO, and be open until spawn() returns */
+bool spawn_attr_set_notify(struct spawn_attr *attr, int fd);
+void spawn_attr_set_sched(struct spawn_attr *attr,
+			  const struct spawn_sched *sched);
+void spawn_attr_set_ioprio(struct spawn_attr *attr,
+			   const struct spawn_ioprio *ioprio);
+/* `mempolicy` must outlive attr */
+void spawn_attr_set_mempolicy(struct spawn_attr *attr,
+			      const struct spawn_mempolicy *mempolicy);
+/* `rlimits` must outlive attr */
+void spawn_attr_set_rlimits(struct spawn_attr *attr,
+			    const struct spawn_rlimit *rlimits, size_t count);
+/* `dir` is a cgroup directory. If false, child stays on init cgroup */
+bool spawn_attr_set_cgroup(struct spawn_attr *attr, const char *dir);
+
+pid_t spawn(const struct spawn_attr *attr);
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Boot and shutdown timeline. Recording must be cheap, as it happens on
+ * init critical path, so it's just a clock read and a store on a static
+ * buffer - formatting is left to dump time. */
+
+#include "timeline.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+static struct timeline_event events[TIMELINE_EVENTS_MAX];
+static size_t event_count;
+static uint64_t dropped;
+
+static const char *const type_names[] = {
+    [TIMELINE_BEGIN] = "begin", [TIMELINE_END] = "end",
+    [TIMELINE_STAGE] = "stage", [TIMELINE_SPAWN] = "spawn",
+    [TIMELINE_READY] = "ready", [TIMELINE_EXIT] = "exit",
+    [TIMELINE_STOP] = "stop"};
+
+void timeline_record(enum timeline_event_type type, const char *name,
+		     pid_t pid, int value)
+{
+	struct timeline_event *e;
+	struct timespec ts;
+
+	assert(type < TIMELINE_EVENT_TYPES);
+
+	if (event_count == TIMELINE_EVENTS_MAX) {
+		dropped++;
+		return;
+	}
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	e = &events[event_count++];
+	e->usec = (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U;
+	e->type = type;
+	e->pid = pid;
+	e->value = value;
+	e->name = (name != NULL) ? name : "";
+}
+
+size_t timeline_count(void) { return event_count; }
+
+const struct timeline_event *timeline_event(size_t i)
+{
+	assert(i < event_count);
+
+	return &events[i];
+}
+
+void timeline_dump(int fd)
+{
+	size_t i;
+
+	(void)dprintf(fd, "# usec\ttype\tpid\tvalue\tname\n");
+	(void)dprintf(fd, "# dropped %" PRIu64 "\n", dropped);
+
+	for (i = 0; i < event_count; i++) {
+		const struct timeline_event *e = &events[i];
+
+		(void)dprintf(fd, "%" PRIu64 "\t%s\t%d\t%d\t%s\n", e->usec,
+			      type_names[e->type], (int)e->pid, e->value,
+			      e->name);
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef TIMELINE_HEADER_
+#define TIMELINE_HEADER_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Events are kept on a preallocated buffer, further ones are dropped */
+#ifndef TIMELINE_EVENTS_MAX
+#define TIMELINE_EVENTS_MAX 4096
+#endif
+
+enum timeline_event_type {
+	TIMELINE_BEGIN, /* Init started phase `name`, like mounting */
+	TIMELINE_END,
+	TIMELINE_STAGE, /* Init stage is now `name` */
+	TIMELINE_SPAWN, /* `pid` spawned for entry `name`, -1 if it couldn't */
+	TIMELINE_READY, /* `pid` notified readiness */
+	/* `pid` exited, `value` is its exit code, or minus the signal that
+	 * killed it */
+	TIMELINE_EXIT,
+	TIMELINE_STOP, /* Entry `name` sent signal `value` to be stopped */
+	TIMELINE_EVENT_TYPES
+};
+
+struct timeline_event {
+	uint64_t usec; /* CLOCK_MONOTONIC */
+	enum timeline_event_type type;
+	pid_t pid;
+	int value;
+	/* Not copied, must live until timeline is dumped: a literal or a
+	 * inittab entry field */
+	const char *name;
+};
+
+void timeline_record(enum timeline_event_type type, const char *name,
+		     pid_t pid, int value);
+size_t timeline_count(void);
+const struct timeline_event *timeline_event(size_t i);
+/* One event per line, tab separated: usec, type, pid, value and name */
+void timeline_dump(int fd);
+
+#endif
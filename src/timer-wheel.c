@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#include "timer-wheel.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#define TIMER_WHEEL_MASK ((uint64_t)TIMER_WHEEL_SLOTS - 1U)
+
+/*
+ * This is a hierarchical timer wheel where each level is a 'digit' (of
+ * TIMER_WHEEL_BITS bits) of the expiry tick. A node is stored on the level of
+ * the most significant digit in which its expiry differs from current tick,
+ * on the slot given by that digit. So, all nodes on a level have the same
+ * higher digits as current tick and a bigger digit on that level. When
+ * current tick reaches the beginning of a slot, its nodes are cascaded to
+ * lower levels. Nodes on level 0 expire when current tick reaches their slot.
+ *
+ * Add and remove are O(1). Finding next event is O(TIMER_WHEEL_LEVELS) using
+ * a bitmap of occupied slots for each level.
+ */
+
+static unsigned int highest_bit(uint64_t v)
+{
+	assert(v != 0U);
+
+	return 63U - (unsigned int)__builtin_clzll(v);
+}
+
+static unsigned int lowest_bit(uint64_t v)
+{
+	assert(v != 0U);
+
+	return (unsigned int)__builtin_ctzll(v);
+}
+
+static unsigned int digit(uint64_t tick, unsigned int level)
+{
+	return (unsigned int)((tick >> (level * TIMER_WHEEL_BITS)) &
+			      TIMER_WHEEL_MASK);
+}
+
+static void list_add(struct timer_wheel_node **head,
+		     struct timer_wheel_node *node)
+{
+	node->next = *head;
+	if (*head != NULL) {
+		(*head)->pprev = &node->next;
+	}
+	*head = node;
+	node->pprev = head;
+}
+
+static void list_del(struct timer_wheel_node *node)
+{
+	*node->pprev = node->next;
+	if (node->next != NULL) {
+		node->next->pprev = node->pprev;
+	}
+	node->next = NULL;
+	node->pprev = NULL;
+}
+
+static void place_node(struct timer_wheel *tw, struct timer_wheel_node *node)
+{
+	unsigned int level = 0, slot;
+
+	if (node->expires > tw->now) {
+		level = highest_bit(node->expires ^ tw->now) / TIMER_WHEEL_BITS;
+		slot = digit(node->expires, level);
+	} else {
+		/* Already due, it will expire on next advance */
+		slot = digit(tw->now, 0);
+	}
+
+	node->level = (int8_t)level;
+	node->slot = (uint8_t)slot;
+	list_add(&tw->slots[level][slot], node);
+	tw->occupied[level] |= (uint64_t)1U << slot;
+}
+
+void timer_wheel_init(struct timer_wheel *tw, uint64_t now)
+{
+	assert(tw != NULL);
+
+	(void)memset(tw, 0, sizeof(struct timer_wheel));
+	tw->now = now;
+}
+
+void timer_wheel_add(struct timer_wheel *tw, struct timer_wheel_node *node,
+		     uint64_t expires)
+{
+	assert(tw != NULL);
+	assert(node != NULL);
+	assert(!timer_wheel_is_pending(node));
+
+	node->expires = expires;
+	place_node(tw, node);
+}
+
+void timer_wheel_remove(struct timer_wheel *tw, struct timer_wheel_node *node)
+{
+	int8_t level;
+	uint8_t slot;
+
+	assert(tw != NULL);
+	assert(node != NULL);
+
+	if (!timer_wheel_is_pending(node)) {
+		return;
+	}
+
+	level = node->level;
+	slot = node->slot;
+	list_del(node);
+
+	/* Nodes on expired lists are not accounted on bitmaps */
+	if ((level >= 0) && (tw->slots[level][slot] == NULL)) {
+		tw->occupied[level] &= ~((uint64_t)1U << slot);
+	}
+}
+
+bool timer_wheel_next_event(const struct timer_wheel *tw, uint64_t *tick)
+{
+	unsigned int level;
+
+	assert(tw != NULL);
+	assert(tick != NULL);
+
+	/* Events on a level always happen before the ones on upper levels, so
+	 * the first occupied level has the next event */
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		unsigned int cur, shift = level * TIMER_WHEEL_BITS;
+		uint64_t bits = tw->occupied[level], block = 0;
+
+		if (bits == 0U) {
+			continue;
+		}
+
+		/* Level 0 may have due nodes on current slot. Upper levels
+		 * only have slots after current one */
+		cur = digit(tw->now, level);
+		if (level == 0U) {
+			bits &= ~(uint64_t)0U << cur;
+		} else if (cur < (TIMER_WHEEL_SLOTS - 1U)) {
+			bits &= ~(uint64_t)0U << (cur + 1U);
+		} else {
+			bits = 0;
+		}
+		assert(bits != 0U);
+
+		if ((shift + TIMER_WHEEL_BITS) < 64U) {
+			block = (tw->now >> (shift + TIMER_WHEEL_BITS))
+				<< (shift + TIMER_WHEEL_BITS);
+		}
+
+		*tick = block | ((uint64_t)lowest_bit(bits) << shift);
+		return true;
+	}
+
+	return false;
+}
+
+static void cascade(struct timer_wheel *tw, unsigned int level,
+		    unsigned int slot)
+{
+	struct timer_wheel_node *node = tw->slots[level][slot];
+
+	tw->slots[level][slot] = NULL;
+	tw->occupied[level] &= ~((uint64_t)1U << slot);
+
+	while (node != NULL) {
+		struct timer_wheel_node *next = node->next;
+
+		node->next = NULL;
+		node->pprev = NULL;
+		place_node(tw, node);
+
+		node = next;
+	}
+}
+
+/* Moves current tick up to `now`, moving every expired node to `expired`
+ * list. Nodes on that list can still be removed with timer_wheel_remove() */
+void timer_wheel_advance(struct timer_wheel *tw, uint64_t now,
+			 struct timer_wheel_node **expired)
+{
+	uint64_t tick;
+
+	assert(tw != NULL);
+	assert(expired != NULL);
+
+	while (timer_wheel_next_event(tw, &tick) && (tick <= now)) {
+		unsigned int level, slot;
+
+		tw->now = tick;
+
+		/* Cascade from upper levels first, so nodes due now reach
+		 * level 0 before it is emptied */
+		for (level = TIMER_WHEEL_LEVELS - 1U; level > 0U; level--) {
+			uint64_t low_bits =
+			    ((uint64_t)1U << (level * TIMER_WHEEL_BITS)) - 1U;
+
+			slot = digit(tick, level);
+			if (((tick & low_bits) == 0U) &&
+			    ((tw->occupied[level] & ((uint64_t)1U << slot)) !=
+			     0U)) {
+				cascade(tw, level, slot);
+			}
+		}
+
+		slot = digit(tick, 0);
+		while (tw->slots[0][slot] != NULL) {
+			struct timer_wheel_node *node = tw->slots[0][slot];
+
+			list_del(node);
+			node->level = -1;
+			list_add(expired, node);
+		}
+		tw->occupied[0] &= ~((uint64_t)1U << slot);
+	}
+
+	if (now > tw->now) {
+		tw->now = now;
+	}
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+#ifndef TIMER_WHEEL_HEADER_
+#define TIMER_WHEEL_HEADER_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Each level has 64 slots, so its occupancy fits in one uint64_t bitmap.
+ * Eleven levels of six bits cover the whole 64 bits tick range. */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1U << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 11
+
+struct timer_wheel_node {
+	struct timer_wheel_node *next;
+	struct timer_wheel_node **pprev; /* NULL if node is not pending */
+	uint64_t expires;
+	int8_t level; /* -1 if node is on an expired list */
+	uint8_t slot;
+};
+
+struct timer_wheel {
+	uint64_t now;
+	uint64_t occupied[TIMER_WHEEL_LEVELS];
+	struct timer_wheel_node *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+void timer_wheel_init(struct timer_wheel *tw, uint64_t now);
+void timer_wheel_add(struct timer_wheel *tw, struct timer_wheel_node *node,
+		     uint64_t expires);
+void timer_wheel_remove(struct timer_wheel *tw, struct timer_wheel_node *node);
+bool timer_wheel_next_event(const struct timer_wheel *tw, uint64_t *tick);
+void timer_wheel_advance(struct timer_wheel *tw, uint64_t now,
+			 struct timer_wheel_node **expired);
+
+static inline bool timer_wheel_is_pending(const struct timer_wheel_node *node)
+{
+	return node->pprev != NULL;
+}
+
+#endif
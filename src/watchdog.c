@@ -104,6 +104,10 @@ void start_watchdog(void)
 		goto end;
 	}
 
+	/* Feeding the watchdog comes before anything else */
+	mainloop_set_timeout_priority(watchdog_timeout,
+				      MAINLOOP_PRIORITY_CRITICAL);
+
 end:
 	return;
 }
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <histogram.h>
+#include <macros.h>
+
+struct bucket_case {
+    uint64_t ns;
+    size_t bucket;
+};
+
+static bool
+test_buckets(void)
+{
+    static const struct bucket_case cases[] = {
+        {0, 0},
+        {999, 0},
+        {1000, 1},
+        {1999, 1},
+        {2000, 2},
+        {3999, 2},
+        {4000, 3},
+        {1000000, 10}, /* 1ms: [512, 1024) us */
+        {1024000, 11},
+        {(uint64_t)1 << 40, HISTOGRAM_BUCKETS - 1},
+        {UINT64_MAX, HISTOGRAM_BUCKETS - 1},
+    };
+    bool result = true;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(cases); i++) {
+        size_t bucket = histogram_bucket(cases[i].ns);
+
+        if (bucket != cases[i].bucket) {
+            printf("TEST: %llu ns on bucket %zu, expected %zu\n",
+                   (unsigned long long)cases[i].ns, bucket, cases[i].bucket);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+static bool
+test_add(void)
+{
+    struct histogram h = {};
+    bool result = true;
+
+    histogram_add(&h, 500);
+    histogram_add(&h, 1500);
+    histogram_add(&h, 1700);
+    histogram_add(&h, 9000000);
+
+    if ((h.count != 4) || (h.total_ns != 9003700) || (h.max_ns != 9000000)) {
+        printf("TEST: Wrong histogram summary: count %llu, total %llu, max %llu\n",
+               (unsigned long long)h.count, (unsigned long long)h.total_ns,
+               (unsigned long long)h.max_ns);
+        result = false;
+    }
+
+    if ((h.buckets[0] != 1) || (h.buckets[1] != 2) || (h.buckets[14] != 1)) {
+        printf("TEST: Wrong histogram buckets\n");
+        result = false;
+    }
+
+    return result;
+}
+
+int main(void)
+{
+    bool success = true;
+
+    success &= test_buckets();
+    success &= test_add();
+
+    if (success) {
+        printf("All tests OK\n");
+    } else {
+        printf("Some tests FAIL\n");
+    }
+
+    return success ? 0 : 1;
+}
@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /*
@@ -14,8 +15,16 @@
  * That's why we include it directly here. This whitebox test is useful
  * because allows a more granular (line by line) checking of parser.
  */
+#define CPU_ONLINE_FILENAME "tests/data/parser/inittab/cpu_online"
+#define NODE_SYSFS_DIRNAME "tests/data/parser/inittab/node"
 #include <inittab.c>
 
+/* cpu_set_t of CPUs on `mask`, up to 64 */
+#define CPU_MASK(mask) { { (mask) } }
+
+/* spawn_mempolicy of nodes on `mask`, up to 64 */
+#define NUMA(policy, mask) { .mode = (policy), .nodes = { (mask) } }
+
 struct test_data {
     const char *file_name;
     struct expected_data {
@@ -36,7 +45,7 @@ static struct test_data parse_assorted_errors = {
                 .ctty_path = "/dev/tty1",
                 .type = ONE_SHOT,
                 .order = 1,
-                .core_id = 2
+                .cpus = CPU_MASK(1UL << 2)
             }
         },
         {
@@ -46,7 +55,7 @@ static struct test_data parse_assorted_errors = {
                 .ctty_path = "/dev/console",
                 .type = SAFE_ONE_SHOT,
                 .order = 4,
-                .core_id = 0
+                .cpus = CPU_MASK(1UL << 0)
             }
         },
         {
@@ -66,8 +75,7 @@ static struct test_data parse_assorted_errors = {
             .entry = {
                 .process_name = "/usr/bin/baz --bar foo",
                 .type = SAFE_MODE,
-                .order = -1,
-                .core_id = -1
+                .order = -1
             }
         },
         {
@@ -116,7 +124,7 @@ static struct test_data parse_ok = {
                 .ctty_path = "",
                 .type = ONE_SHOT,
                 .order = 1,
-                .core_id = 2
+                .cpus = CPU_MASK(1UL << 2)
             }
         },
         {
@@ -126,7 +134,7 @@ static struct test_data parse_ok = {
                 .ctty_path = "/dev/console",
                 .type = SAFE_ONE_SHOT,
                 .order = 2,
-                .core_id = 0
+                .cpus = CPU_MASK(1UL << 0)
             }
         },
         {
@@ -134,8 +142,7 @@ static struct test_data parse_ok = {
             .entry = {
                 .process_name = "/usr/bin/foo --baz bar",
                 .type = SERVICE,
-                .order = 1,
-                .core_id = -1
+                .order = 1
             }
         },
         {
@@ -143,8 +150,7 @@ static struct test_data parse_ok = {
             .entry = {
                 .process_name = "/usr/bin/bar --foo baz",
                 .type = SAFE_MODE,
-                .order = -1,
-                .core_id = -1
+                .order = -1
             }
         },
         {
@@ -153,7 +159,7 @@ static struct test_data parse_ok = {
                 .process_name = "/usr/bin/baz --foo baz",
                 .type = SHUTDOWN,
                 .order = 1,
-                .core_id = 2
+                .cpus = CPU_MASK(1UL << 2)
             }
         },
         {
@@ -162,7 +168,7 @@ static struct test_data parse_ok = {
                 .process_name = "/usr/bin/baz --bar foo",
                 .type = SAFE_SHUTDOWN,
                 .order = 0,
-                .core_id = 1
+                .cpus = CPU_MASK(1UL << 1)
             }
         },
         {
@@ -171,7 +177,7 @@ static struct test_data parse_ok = {
                 .process_name = "/usr/bin/safe --wut wat",
                 .type = SAFE_MODE,
                 .order = 0,
-                .core_id = 0
+                .cpus = CPU_MASK(1UL << 0)
             }
         },
         {
@@ -206,7 +212,7 @@ static struct test_data parse_line_too_big = {
                 .process_name = "/usr/bin/foo --bar baz",
                 .type = ONE_SHOT,
                 .order = 1,
-                .core_id = 2
+                .cpus = CPU_MASK(1UL << 2)
             }
         },
         {
@@ -215,7 +221,7 @@ static struct test_data parse_line_too_big = {
                 .process_name = "/usr/bin/bar --baz foo",
                 .type = SAFE_MODE,
                 .order = -1,
-                .core_id = 0
+                .cpus = CPU_MASK(1UL << 0)
             }
         },
         {
@@ -227,8 +233,7 @@ static struct test_data parse_line_too_big = {
             .entry = {
                 .process_name = "/usr/bin/bar --foo baz",
                 .type = SAFE_SERVICE,
-                .order = 5,
-                .core_id = -1
+                .order = 5
             }
         },
         {
@@ -237,7 +242,7 @@ static struct test_data parse_line_too_big = {
                 .process_name = "/usr/bin/baz --foo baz",
                 .type = SHUTDOWN,
                 .order = 1,
-                .core_id = 2
+                .cpus = CPU_MASK(1UL << 2)
             }
         },
         {
@@ -246,7 +251,7 @@ static struct test_data parse_line_too_big = {
                 .process_name = "/usr/bin/baz --bar foo",
                 .type = SAFE_SHUTDOWN,
                 .order = 0,
-                .core_id = 1
+                .cpus = CPU_MASK(1UL << 1)
             }
         },
         {
@@ -255,7 +260,7 @@ static struct test_data parse_line_too_big = {
                 .process_name = "/usr/bin/safe --wut wat",
                 .type = SAFE_MODE,
                 .order = 0,
-                .core_id = 0
+                .cpus = CPU_MASK(1UL << 0)
             }
         },
         {
@@ -277,58 +282,850 @@ static struct test_data parse_empty = {
     }
 };
 
-static bool
-entry_equal(struct inittab_entry *a, struct inittab_entry *b)
-{
-    return (strncmp(a->process_name, b->process_name, sizeof(a->process_name)) == 0)
-        && (strncmp(a->ctty_path, b->ctty_path, sizeof(a->ctty_path)) == 0)
-        && (a->type == b->type)
-        && (a->order == b->order)
-        && (a->core_id == b->core_id);
-}
-
-static bool
-perform_test(struct test_data *td)
-{
-    assert(td);
-
-    int i = 0;
-    bool result = true;
-    FILE *fp = fopen(td->file_name, "re");
-    assert(fp);
-
-    while (td->expected_data[i].result != -1U) {
-        struct inittab_entry entry = { };
-        enum inittab_parse_result r = inittab_parse_entry(fp, &entry);
-
-        if (r != td->expected_data[i].result) {
-            printf("TEST %s: Unexpected return from `inittab_parse_entry`: %d for entry %d. Expected %d\n",
-                    td->file_name, r, i, td->expected_data[i].result);
-            result = false;
-        } else if (td->expected_data[i].result == RESULT_OK) {
-            if (!entry_equal(&td->expected_data[i].entry, &entry)) {
-                printf("TEST %s: Mismatch for entry %d\n", td->file_name, i);
-                result = false;
+static struct test_data parse_cmdline_data = {
+    .file_name = "tests/data/parser/inittab/parse_cmdline",
+    .expected_data = {
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "FOO=bar /usr/bin/foo 'a b' \"c 'd'\"",
+                .type = ONE_SHOT,
+                .order = 1,
+                .cmd = {
+                    .args = {"/usr/bin/foo", "a b", "c 'd'"},
+                    .env = {"FOO=bar"}
+                },
+                .exec_path = "/usr/bin/foo"
             }
-        } else {
-            /* OK */
-        }
-
-        i++;
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "sh -c true",
+                .type = ONE_SHOT,
+                .order = 2,
+                .cmd = {
+                    .args = {"sh", "-c", "true"}
+                },
+                .exec_path = "/bin/sh"
+            }
+        },
+        {
+            .result = RESULT_DONE,
+            .entry = { }
+        },
+        EXPECTED_END
     }
+};
 
-    return result;
-}
-
-int main(void)
-{
-    bool success = true;
+static struct test_data parse_options_data = {
+    .file_name = "tests/data/parser/inittab/parse_options",
+    .expected_data = {
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/foo",
+                .type = ONE_SHOT,
+                .order = 1,
+                .id = "storage"
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/bar",
+                .type = SERVICE,
+                .order = 2,
+                .id = "net-1.0",
+                .after_ids = "storage,foo_bar"
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/baz",
+                .type = SERVICE,
+                .order = 3,
+                .ready_notify = true
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/baz",
+                .type = ONE_SHOT,
+                .order = 4,
+                .timeout_ms = 1500,
+                .on_timeout = DEADLINE_RETRY,
+                .retries = 2
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/baz",
+                .type = SERVICE,
+                .order = 4,
+                .ready_notify = true,
+                .timeout_ms = 1500,
+                .on_timeout = DEADLINE_KILL_AND_SAFE_MODE
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/qux",
+                .type = SERVICE,
+                .order = 5,
+                .restart = RESTART_ON_FAILURE,
+                .restart_delay_ms = 200,
+                .restart_limit = 3,
+                .restart_window_ms = 5000
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/qux",
+                .type = SERVICE,
+                .order = 5,
+                .restart = RESTART_ALWAYS,
+                .restart_delay_ms = DEFAULT_RESTART_DELAY,
+                .restart_limit = DEFAULT_RESTART_LIMIT,
+                .restart_window_ms = DEFAULT_RESTART_WINDOW
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/quux",
+                .type = SERVICE,
+                .order = 6,
+                .stop_signal = SIGUSR1,
+                .stop_timeout_ms = 500
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/quux",
+                .type = ONE_SHOT,
+                .order = 6,
+                .stop_signal = SIGINT,
+                .stop_timeout_ms = DEFAULT_STOP_TIMEOUT
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/corge",
+                .type = SERVICE,
+                .order = 7,
+                .sched = {.policy = SCHED_FIFO, .priority = 50}
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/corge",
+                .type = ONE_SHOT,
+                .order = 7,
+                .sched = {
+                    .policy = SCHED_DEADLINE,
+                    .runtime_us = 2000,
+                    .deadline_us = 5000,
+                    .period_us = 10000
+                }
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/corge",
+                .type = SERVICE,
+                .order = 7,
+                .sched = {.policy = SCHED_IDLE}
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/grault",
+                .type = SERVICE,
+                .order = 8,
+                .id = "db",
+                .limits = {
+                    .cpu_quota_us = 50000,
+                    .cpu_period_us = 200000,
+                    .cpu_weight = 200,
+                    .memory_max = 512 * 1024 * 1024,
+                    .memory_high = 384 * 1024 * 1024
+                }
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/grault",
+                .type = ONE_SHOT,
+                .order = 8,
+                .limits = {
+                    .cpu_quota_us = 20000,
+                    .cpu_period_us = DEFAULT_CPU_PERIOD,
+                    .memory_max = 4096
+                }
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/garply",
+                .type = SERVICE,
+                .order = 9,
+                .rlimits = {
+                    {RLIMIT_NOFILE, {1024, 65536}},
+                    {RLIMIT_MEMLOCK, {RLIM_INFINITY, RLIM_INFINITY}},
+                    {RLIMIT_CORE, {0, 0}}
+                },
+                .rlimit_count = 3
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/garply",
+                .type = ONE_SHOT,
+                .order = 9,
+                .rlimits = {
+                    {RLIMIT_STACK, {16 * 1024 * 1024, RLIM_INFINITY}},
+                    {RLIMIT_RTPRIO, {50, 50}}
+                },
+                .rlimit_count = 2
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/waldo",
+                .type = SERVICE,
+                .order = 10,
+                .ioprio = {SPAWN_IOPRIO_CLASS_RT, 0}
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/waldo",
+                .type = ONE_SHOT,
+                .order = 10,
+                .ioprio = {SPAWN_IOPRIO_CLASS_IDLE, 0}
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/waldo",
+                .type = SERVICE,
+                .order = 10,
+                .ioprio = {SPAWN_IOPRIO_CLASS_BE, 7}
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/waldo",
+                .type = SHUTDOWN,
+                .order = 10,
+                .ioprio = {SPAWN_IOPRIO_CLASS_BE, 4}
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/waldo",
+                .type = SERVICE,
+                .order = 10,
+                .ioprio = {SPAWN_IOPRIO_CLASS_BE, 4}
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_DONE,
+            .entry = { }
+        },
+        EXPECTED_END
+    }
+};
+
+/* CPUs online on tests are 0-7, see CPU_ONLINE_FILENAME, and nodes 0-1,
+ * see NODE_SYSFS_DIRNAME */
+static struct test_data parse_cpus_data = {
+    .file_name = "tests/data/parser/inittab/parse_cpus",
+    .expected_data = {
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/foo",
+                .type = ONE_SHOT,
+                .order = 1,
+                .cpus = CPU_MASK(0xf4)
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/foo",
+                .type = ONE_SHOT,
+                .order = 1,
+                .cpus = CPU_MASK(0xb)
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/foo",
+                .type = ONE_SHOT,
+                .order = 1,
+                .cpus = CPU_MASK(0xc0) /* Offline 8 and 9 are dropped */
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/foo",
+                .type = ONE_SHOT,
+                .order = 1,
+                .cpus = CPU_MASK(0xf0),
+                .mempolicy = NUMA(MPOL_BIND, 0x2)
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/foo",
+                .type = ONE_SHOT,
+                .order = 1,
+                .cpus = CPU_MASK(0xff),
+                .mempolicy = NUMA(MPOL_INTERLEAVE, 0x3)
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/foo",
+                .type = ONE_SHOT,
+                .order = 1,
+                .cpus = CPU_MASK(0x4), /* <core-id> wins */
+                .mempolicy = NUMA(MPOL_PREFERRED, 0x2)
+            }
+        },
+        {
+            .result = RESULT_OK,
+            .entry = {
+                .process_name = "/usr/bin/foo",
+                .type = ONE_SHOT,
+                .order = 1,
+                .cpus = CPU_MASK(0xf0),
+                .mempolicy = NUMA(MPOL_BIND, 0x2) /* Offline 2 is dropped */
+            }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_ERROR,
+            .entry = { }
+        },
+        {
+            .result = RESULT_DONE,
+            .entry = { }
+        },
+        EXPECTED_END
+    }
+};
+
+/* Whole inittab files, checking how entries are linked after read */
+struct link_test_data {
+    const char *file_name;
+    bool result;
+    /* Number of dependencies of each startup entry, on list order */
+    size_t after_count[8];
+};
+
+static struct link_test_data link_ok = {
+    .file_name = "tests/data/parser/inittab/link_ok",
+    .result = true,
+    /* a, b, c (a, b), d (b), e (a, b, d), f (e, c) */
+    .after_count = {0, 0, 2, 1, 3, 2}
+};
+
+/* Services notifying readiness are waited for, like one-shots */
+static struct link_test_data link_ready = {
+    .file_name = "tests/data/parser/inittab/link_ready",
+    .result = true,
+    .after_count = {0, 0, 1}
+};
+
+static struct link_test_data link_unknown_id = {
+    .file_name = "tests/data/parser/inittab/link_unknown_id",
+    .result = false
+};
+
+static struct link_test_data link_other_list = {
+    .file_name = "tests/data/parser/inittab/link_other_list",
+    .result = false
+};
+
+static struct link_test_data link_duplicated_id = {
+    .file_name = "tests/data/parser/inittab/link_duplicated_id",
+    .result = false
+};
+
+/* Startup and shutdown entries can't share an id either */
+static struct link_test_data link_duplicated_id_other_list = {
+    .file_name = "tests/data/parser/inittab/link_duplicated_id_other_list",
+    .result = false
+};
+
+static struct link_test_data link_cycle = {
+    .file_name = "tests/data/parser/inittab/link_cycle",
+    .result = false
+};
+
+static bool
+strv_equal(const char *const *a, const char *const *b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        if ((a[i] == NULL) || (b[i] == NULL)) {
+            return a[i] == b[i];
+        }
+        if (strcmp(a[i], b[i]) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Parsed command line is only checked if expected entry defines it */
+static bool
+cmd_equal(struct inittab_entry *a, struct inittab_entry *b)
+{
+    if (a->cmd.args[0] == NULL) {
+        return true;
+    }
+
+    return strv_equal(a->cmd.args, b->cmd.args, ARGS_MAX)
+        && strv_equal(a->cmd.env, b->cmd.env, ENV_MAX)
+        && (strcmp(a->exec_path, b->exec_path) == 0);
+}
+
+static bool
+rlimits_equal(struct inittab_entry *a, struct inittab_entry *b)
+{
+    size_t i;
+
+    if (a->rlimit_count != b->rlimit_count) {
+        return false;
+    }
+
+    for (i = 0; i < a->rlimit_count; i++) {
+        if ((a->rlimits[i].resource != b->rlimits[i].resource)
+            || (a->rlimits[i].limit.rlim_cur != b->rlimits[i].limit.rlim_cur)
+            || (a->rlimits[i].limit.rlim_max != b->rlimits[i].limit.rlim_max)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+entry_equal(struct inittab_entry *a, struct inittab_entry *b)
+{
+    return (strncmp(a->process_name, b->process_name, sizeof(a->process_name)) == 0)
+        && (strncmp(a->ctty_path, b->ctty_path, sizeof(a->ctty_path)) == 0)
+        && (a->type == b->type)
+        && (a->order == b->order)
+        && CPU_EQUAL(&a->cpus, &b->cpus)
+        && (strcmp(a->id, b->id) == 0)
+        && (strcmp(a->after_ids, b->after_ids) == 0)
+        && (a->ready_notify == b->ready_notify)
+        && (a->timeout_ms == b->timeout_ms)
+        && (a->on_timeout == b->on_timeout)
+        /* Retries are only checked if expected entry defines them */
+        && ((a->retries == 0) || (a->retries == b->retries))
+        && (a->restart == b->restart)
+        /* So are restart limits */
+        && ((a->restart_delay_ms == 0) || (a->restart_delay_ms == b->restart_delay_ms))
+        && ((a->restart_limit == 0) || (a->restart_limit == b->restart_limit))
+        && ((a->restart_window_ms == 0) || (a->restart_window_ms == b->restart_window_ms))
+        && ((a->stop_signal == 0) || (a->stop_signal == b->stop_signal))
+        && ((a->stop_timeout_ms == 0) || (a->stop_timeout_ms == b->stop_timeout_ms))
+        && (a->sched.policy == b->sched.policy)
+        && (a->sched.priority == b->sched.priority)
+        && (a->sched.runtime_us == b->sched.runtime_us)
+        && (a->sched.deadline_us == b->sched.deadline_us)
+        && (a->sched.period_us == b->sched.period_us)
+        && (a->ioprio.class == b->ioprio.class)
+        /* Level is only checked if expected entry defines a class */
+        && ((a->ioprio.class == SPAWN_IOPRIO_CLASS_NONE) || (a->ioprio.level == b->ioprio.level))
+        && (a->limits.cpu_quota_us == b->limits.cpu_quota_us)
+        && (a->limits.cpu_period_us == b->limits.cpu_period_us)
+        && (a->limits.cpu_weight == b->limits.cpu_weight)
+        && (a->limits.memory_max == b->limits.memory_max)
+        && (a->limits.memory_high == b->limits.memory_high)
+        && rlimits_equal(a, b)
+        && (a->mempolicy.mode == b->mempolicy.mode)
+        && (memcmp(a->mempolicy.nodes, b->mempolicy.nodes, sizeof(a->mempolicy.nodes)) == 0)
+        && cmd_equal(a, b);
+}
+
+static bool
+perform_test(struct test_data *td)
+{
+    assert(td);
+
+    int i = 0;
+    bool result = true;
+    FILE *fp = fopen(td->file_name, "re");
+    assert(fp);
+
+    while (td->expected_data[i].result != -1U) {
+        struct inittab_entry entry = { };
+        enum inittab_parse_result r = inittab_parse_entry(fp, &entry);
+
+        if (r != td->expected_data[i].result) {
+            printf("TEST %s: Unexpected return from `inittab_parse_entry`: %d for entry %d. Expected %d\n",
+                    td->file_name, r, i, td->expected_data[i].result);
+            result = false;
+        } else if (td->expected_data[i].result == RESULT_OK) {
+            if (!entry_equal(&td->expected_data[i].entry, &entry)) {
+                printf("TEST %s: Mismatch for entry %d\n", td->file_name, i);
+                result = false;
+            }
+        } else {
+            /* OK */
+        }
+
+        free_cmdline_contents(&entry.cmd);
+        i++;
+    }
+
+    return result;
+}
+
+static bool
+perform_link_test(struct link_test_data *td)
+{
+    struct inittab inittab = { };
+    struct inittab_entry *entry;
+    bool result;
+    size_t i = 0;
+
+    result = read_inittab(td->file_name, &inittab);
+    if (result != td->result) {
+        printf("TEST %s: Unexpected return from `read_inittab`: %d. Expected %d\n",
+                td->file_name, result, td->result);
+        /* Lists are freed by read_inittab on failure */
+        return false;
+    } else if (!result) {
+        return true;
+    }
+
+    for (entry = inittab.startup_list; entry != NULL; entry = entry->next, i++) {
+        if ((i >= sizeof(td->after_count) / sizeof(td->after_count[0]))
+            || (entry->after_count != td->after_count[i])) {
+            printf("TEST %s: Unexpected dependencies for entry %zu\n",
+                    td->file_name, i);
+            result = false;
+            break;
+        }
+    }
+
+    free_inittab_entry_list(inittab.startup_list);
+    free_inittab_entry_list(inittab.shutdown_list);
+    free_inittab_entry_list(inittab.safe_mode_entry);
+
+    return result;
+}
+
+int main(void)
+{
+    bool success = true;
+
+    /* So executables are resolved to known paths */
+    setenv("PATH", "/nonexistent:/bin", 1);
 
     success &= perform_test(&parse_ok);
     success &= perform_test(&parse_assorted_errors);
     success &= perform_test(&parse_comment_too_big);
     success &= perform_test(&parse_line_too_big);
     success &= perform_test(&parse_empty);
+    success &= perform_test(&parse_cmdline_data);
+    success &= perform_test(&parse_options_data);
+    success &= perform_test(&parse_cpus_data);
+    success &= perform_link_test(&link_ok);
+    success &= perform_link_test(&link_ready);
+    success &= perform_link_test(&link_unknown_id);
+    success &= perform_link_test(&link_other_list);
+    success &= perform_link_test(&link_duplicated_id);
+    success &= perform_link_test(&link_duplicated_id_other_list);
+    success &= perform_link_test(&link_cycle);
 
     if (success) {
         printf("All tests OK\n");
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Measures how many syscalls mainloop does to handle events, for each
+ * available backend:
+ *  - children: notice and reap children started in bursts, like on a stage
+ *    with several one-shot entries;
+ *  - signals: handle bursts of queued signals, to see how batched signalfd
+ *    reads pay off. `make benchmarks` also builds `mainloop_bench_nobatch`,
+ *    with SIGNAL_BATCH_MAX=1, to compare. */
+
+#include <assert.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mainloop.h>
+
+#define CHILDREN 2000
+#define CHILDREN_BURST 20
+
+#define SIGNALS 200000
+#define SIGNALS_BURST 32
+
+static unsigned int started;
+static unsigned int reaped;
+static unsigned int alive;
+
+static unsigned int sent;
+static unsigned int received;
+static unsigned int burst_left;
+
+static void start_burst(void)
+{
+    unsigned int i;
+
+    for (i = 0; (i < CHILDREN_BURST) && (started < CHILDREN); i++) {
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            _exit(EXIT_SUCCESS);
+        }
+
+        started++;
+        alive++;
+    }
+}
+
+static void sigchld_cb(struct signalfd_siginfo *info, size_t count)
+{
+    pid_t pid;
+
+    (void)info;
+    (void)count;
+
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        reaped++;
+        alive--;
+    }
+
+    if (reaped == CHILDREN) {
+        mainloop_exit();
+    } else if (alive == 0) {
+        start_burst();
+    }
+}
+
+/* Real time signals are queued, so each one is a signalfd record */
+static void send_burst(void)
+{
+    unsigned int i;
+    union sigval value = {};
+
+    for (i = 0; (i < SIGNALS_BURST) && (sent < SIGNALS); i++) {
+        if (sigqueue(getpid(), SIGRTMIN, value) < 0) {
+            perror("sigqueue");
+            exit(EXIT_FAILURE);
+        }
+        sent++;
+    }
+    burst_left = i;
+}
+
+static void sigrt_cb(struct signalfd_siginfo *info, size_t count)
+{
+    (void)info;
+
+    received += count;
+    burst_left -= count;
+
+    if (received == SIGNALS) {
+        mainloop_exit();
+    } else if (burst_left == 0) {
+        send_burst();
+    }
+}
+
+static void
+report(const char *scenario, const char *name, unsigned int n, const struct timespec *start)
+{
+    struct mainloop_counters counters;
+    struct timespec end;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    mainloop_get_counters(&counters);
+    elapsed = (double)(end.tv_sec - start->tv_sec)
+              + ((double)(end.tv_nsec - start->tv_nsec) / 1e9);
+
+    printf("%-9s %-9s %6u: %.3f syscalls, %.3f wakeups, %.3f events each, %.3fs\n",
+           scenario, name, n,
+           (double)counters.syscalls / n,
+           (double)counters.wakeups / n,
+           (double)counters.events / n, elapsed);
+}
+
+static bool
+run(enum mainloop_backend_type type, bool signals)
+{
+    sigset_t mask;
+    struct timespec start;
+    const char *name;
+
+    if (!mainloop_setup_backend(type)) {
+        return false;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, signals ? SIGRTMIN : SIGCHLD);
+    if (mainloop_add_signal_handler(&mask, signals ? sigrt_cb : sigchld_cb) == NULL) {
+        return false;
+    }
+
+    name = mainloop_backend_name();
+    if (signals) {
+        send_burst();
+    } else {
+        start_burst();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!mainloop_start()) {
+        return false;
+    }
+
+    if (signals) {
+        report("signals", name, SIGNALS, &start);
+    } else {
+        report("children", name, CHILDREN, &start);
+    }
+
+    return true;
+}
+
+/* Counters are cumulative, so each run must be done on its own process */
+static void
+run_forked(enum mainloop_backend_type type, bool signals)
+{
+    fflush(stdout);
+    if (fork() == 0) {
+        exit(run(type, signals) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    wait(NULL);
+}
+
+int main(void)
+{
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGRTMIN);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    printf("Signal batch: %d\n", SIGNAL_BATCH_MAX);
+
+    run_forked(MAINLOOP_BACKEND_EPOLL, false);
+    run_forked(MAINLOOP_BACKEND_EPOLL, true);
+
+#ifdef MAINLOOP_IO_URING
+    run_forked(MAINLOOP_BACKEND_IO_URING, false);
+    run_forked(MAINLOOP_BACKEND_IO_URING, true);
+#else
+    printf("io_uring backend not built, use IO_URING=1\n");
+#endif
+
+    return EXIT_SUCCESS;
+}
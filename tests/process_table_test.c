@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <process-table.h>
+
+#define PROCESSES 1000
+
+static bool
+check_all(const struct process_table *pt, struct process *processes, const bool *present)
+{
+    bool result = true;
+    size_t i;
+
+    for (i = 0; i < PROCESSES; i++) {
+        struct process *found = process_table_find(pt, processes[i].pid);
+
+        if (present[i] && (found != &processes[i])) {
+            printf("TEST: pid %d not found\n", processes[i].pid);
+            result = false;
+        } else if (!present[i] && (found != NULL)) {
+            printf("TEST: removed pid %d found\n", processes[i].pid);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+/* Removes in an order that leaves holes on probe sequences, to exercise
+ * backward shift deletion */
+static bool
+test_add_remove(void)
+{
+    struct process_table pt;
+    struct process *processes = calloc(PROCESSES, sizeof(struct process));
+    bool present[PROCESSES] = {};
+    bool result = true;
+    size_t i;
+
+    if ((processes == NULL) || !process_table_init(&pt)) {
+        printf("TEST: Could not allocate\n");
+        free(processes);
+        return false;
+    }
+
+    for (i = 0; i < PROCESSES; i++) {
+        processes[i].pid = (pid_t)(i * 7 + 2);
+        processes[i].kind = PROCESS_KIND_SERVICE;
+        if (!process_table_add(&pt, &processes[i])) {
+            printf("TEST: Could not add pid %d\n", processes[i].pid);
+            result = false;
+            goto out;
+        }
+        present[i] = true;
+    }
+
+    result &= check_all(&pt, processes, present);
+
+    for (i = 0; i < PROCESSES; i += 3) {
+        process_table_remove(&pt, &processes[i]);
+        present[i] = false;
+    }
+
+    result &= check_all(&pt, processes, present);
+
+    if ((pt.count != process_table_count(&pt, PROCESS_KIND_SERVICE)) ||
+        (pt.count != PROCESSES - (PROCESSES + 2) / 3)) {
+        printf("TEST: Wrong count %zu\n", pt.count);
+        result = false;
+    }
+
+    for (i = 0; i < PROCESSES; i++) {
+        if (present[i]) {
+            process_table_remove(&pt, &processes[i]);
+            present[i] = false;
+        }
+    }
+
+    result &= check_all(&pt, processes, present);
+
+    if ((pt.count != 0) || (process_table_first(&pt, PROCESS_KIND_SERVICE) != NULL)) {
+        printf("TEST: Table not empty\n");
+        result = false;
+    }
+
+out:
+    for (i = 0; i < PROCESSES; i++) {
+        if (present[i]) {
+            process_table_remove(&pt, &processes[i]);
+        }
+    }
+    process_table_free(&pt);
+    free(processes);
+
+    return result;
+}
+
+static bool
+test_kinds(void)
+{
+    struct process_table pt;
+    struct process processes[4] = {
+        {.pid = 10, .kind = PROCESS_KIND_SAFE_MODE},
+        {.pid = 11, .kind = PROCESS_KIND_ONE_SHOT},
+        {.pid = 12, .kind = PROCESS_KIND_SERVICE},
+        {.pid = 13, .kind = PROCESS_KIND_ONE_SHOT},
+    };
+    bool result = true;
+    size_t i;
+
+    if (!process_table_init(&pt)) {
+        return false;
+    }
+
+    for (i = 0; i < 4; i++) {
+        process_table_add(&pt, &processes[i]);
+    }
+
+    if (process_table_first(&pt, PROCESS_KIND_SAFE_MODE) != &processes[0]) {
+        printf("TEST: Safe mode process not found\n");
+        result = false;
+    }
+
+    if (process_table_count(&pt, PROCESS_KIND_ONE_SHOT) != 2) {
+        printf("TEST: Wrong one-shot count\n");
+        result = false;
+    }
+
+    /* Removing from the middle of a list keeps the rest */
+    process_table_remove(&pt, &processes[3]);
+    if ((process_table_first(&pt, PROCESS_KIND_ONE_SHOT) != &processes[1]) ||
+        (processes[1].next != NULL)) {
+        printf("TEST: Wrong one-shot list after remove\n");
+        result = false;
+    }
+
+    for (i = 0; i < 3; i++) {
+        process_table_remove(&pt, &processes[i]);
+    }
+
+    process_table_free(&pt);
+
+    return result;
+}
+
+int main(void)
+{
+    bool success = true;
+
+    success &= test_add_remove();
+    success &= test_kinds();
+
+    if (success) {
+        printf("All tests OK\n");
+    } else {
+        printf("Some tests FAIL\n");
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Compares how long it takes to start children with fork(), as init used
+ * to do, and with spawn(), which clones a child sharing init memory. Fork
+ * cost grows with parent memory, so each engine is run with a few amounts
+ * of touched memory, standing for init RSS. Each child is reaped before
+ * next one is started. */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <spawn.h>
+
+#define SPAWNS 1000
+#define COMMAND "/bin/true"
+
+static const size_t ballast_mb[] = {0, 64, 256};
+
+/* What setup_child() used to do on forked child */
+static pid_t fork_exec(const struct spawn_attr *attr)
+{
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        (void)setsid();
+        if (attr->set_affinity) {
+            (void)sched_setaffinity(0, sizeof(attr->affinity), &attr->affinity);
+        }
+        (void)dup2(attr->stdin_fd, STDIN_FILENO);
+        (void)dup2(attr->stdout_fd, STDOUT_FILENO);
+        (void)dup2(attr->stdout_fd, STDERR_FILENO);
+        (void)execve(attr->exec_path, (char *const *)attr->cmd->args,
+                     (char *const *)attr->cmd->env);
+        _exit(EXIT_FAILURE);
+    }
+
+    return pid;
+}
+
+static bool
+run(const char *name, pid_t (*engine)(const struct spawn_attr *),
+    const struct spawn_attr *attr, size_t mb)
+{
+    struct timespec start, end;
+    double elapsed;
+    unsigned int i;
+    int status;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < SPAWNS; i++) {
+        pid_t pid = engine(attr);
+
+        if (pid < 0) {
+            perror(name);
+            return false;
+        }
+
+        if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) ||
+            (WEXITSTATUS(status) != EXIT_SUCCESS)) {
+            fprintf(stderr, "%s: child failed\n", name);
+            return false;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (double)(end.tv_sec - start.tv_sec)
+              + ((double)(end.tv_nsec - start.tv_nsec) / 1e9);
+
+    printf("%-6s %4zu MiB %5u: %.1f us each, %.3fs\n", name, mb, SPAWNS,
+           elapsed * 1e6 / SPAWNS, elapsed);
+
+    return true;
+}
+
+int main(void)
+{
+    struct cmdline_contents cmd = {};
+    struct spawn_attr attr;
+    sigset_t mask;
+    size_t i;
+    bool result = true;
+
+    /* As on init, SIGCHLD is handled synchronously */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    if (!parse_cmdline(COMMAND, &cmd)
+        || !spawn_attr_init(&attr, &cmd, COMMAND, "", NULL)) {
+        fprintf(stderr, "Could not prepare '%s'\n", COMMAND);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; result && (i < sizeof(ballast_mb) / sizeof(ballast_mb[0])); i++) {
+        size_t size = ballast_mb[i] * 1024 * 1024;
+        char *ballast = NULL;
+
+        if (size > 0) {
+            ballast = malloc(size);
+            if (ballast == NULL) {
+                perror("malloc");
+                result = false;
+                break;
+            }
+            /* Make it resident, so fork has page tables to copy */
+            memset(ballast, 1, size);
+        }
+
+        result = run("fork", fork_exec, &attr, ballast_mb[i])
+                 && run("spawn", spawn, &attr, ballast_mb[i]);
+
+        free(ballast);
+    }
+
+    spawn_attr_destroy(&attr);
+    free_cmdline_contents(&cmd);
+
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <timeline.h>
+
+static bool
+test_record(void)
+{
+    const struct timeline_event *e;
+    bool result = true;
+
+    timeline_record(TIMELINE_STAGE, "startup", 0, 0);
+    timeline_record(TIMELINE_SPAWN, "/usr/bin/foo", 42, 0);
+    timeline_record(TIMELINE_EXIT, "/usr/bin/foo", 42, -9);
+
+    if (timeline_count() != 3) {
+        printf("TEST: %zu events recorded, expected 3\n", timeline_count());
+        return false;
+    }
+
+    e = timeline_event(2);
+    if ((e->type != TIMELINE_EXIT) || (e->pid != 42) || (e->value != -9)
+        || (strcmp(e->name, "/usr/bin/foo") != 0)) {
+        printf("TEST: Wrong exit event recorded\n");
+        result = false;
+    }
+
+    if (timeline_event(0)->usec > e->usec) {
+        printf("TEST: Events not in time order\n");
+        result = false;
+    }
+
+    return result;
+}
+
+static bool
+test_dump(void)
+{
+    char line[256];
+    unsigned long long usec;
+    char type[16], name[64];
+    int pid, value;
+    bool result = true;
+    FILE *f = tmpfile();
+
+    if (f == NULL) {
+        printf("TEST: Could not create temporary file\n");
+        return false;
+    }
+
+    timeline_dump(fileno(f));
+    rewind(f);
+
+    if ((fgets(line, sizeof(line), f) == NULL) || (line[0] != '#')
+        || (fgets(line, sizeof(line), f) == NULL)
+        || (strcmp(line, "# dropped 0\n") != 0)) {
+        printf("TEST: Wrong timeline header\n");
+        result = false;
+    }
+
+    /* Exit event is the third one */
+    if ((fgets(line, sizeof(line), f) == NULL)
+        || (fgets(line, sizeof(line), f) == NULL)
+        || (fgets(line, sizeof(line), f) == NULL)
+        || (sscanf(line, "%llu\t%15s\t%d\t%d\t%63[^\n]", &usec, type, &pid,
+                   &value, name) != 5)
+        || (strcmp(type, "exit") != 0) || (pid != 42) || (value != -9)
+        || (strcmp(name, "/usr/bin/foo") != 0)) {
+        printf("TEST: Wrong timeline line: %s", line);
+        result = false;
+    }
+
+    fclose(f);
+
+    return result;
+}
+
+/* Buffer is never grown, events past it are just counted */
+static bool
+test_full(void)
+{
+    char line[256];
+    bool result = true;
+    FILE *f;
+    size_t i;
+
+    for (i = timeline_count(); i < TIMELINE_EVENTS_MAX + 5; i++) {
+        timeline_record(TIMELINE_READY, "/usr/bin/bar", 1, 0);
+    }
+
+    if (timeline_count() != TIMELINE_EVENTS_MAX) {
+        printf("TEST: %zu events recorded, expected %d\n", timeline_count(),
+               TIMELINE_EVENTS_MAX);
+        result = false;
+    }
+
+    f = tmpfile();
+    if (f == NULL) {
+        printf("TEST: Could not create temporary file\n");
+        return false;
+    }
+
+    timeline_dump(fileno(f));
+    rewind(f);
+
+    if ((fgets(line, sizeof(line), f) == NULL)
+        || (fgets(line, sizeof(line), f) == NULL)
+        || (strcmp(line, "# dropped 5\n") != 0)) {
+        printf("TEST: Wrong dropped events count: %s", line);
+        result = false;
+    }
+
+    fclose(f);
+
+    return result;
+}
+
+int main(void)
+{
+    bool success = true;
+
+    /* Order matters, as timeline is global */
+    success &= test_record();
+    success &= test_dump();
+    success &= test_full();
+
+    if (success) {
+        printf("All tests OK\n");
+    } else {
+        printf("Some tests FAIL\n");
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2018 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <macros.h>
+#include <timer-wheel.h>
+
+#define RANDOM_NODES 512
+
+struct test_node {
+    struct timer_wheel_node node;
+    bool expired;
+};
+
+/* Advances wheel to `now`, marking expired nodes. Returns false if any node
+ * expired before (or after) its time */
+static bool
+advance_and_check(struct timer_wheel *tw, uint64_t now)
+{
+    bool result = true;
+    struct timer_wheel_node *expired = NULL;
+
+    timer_wheel_advance(tw, now, &expired);
+
+    while (expired != NULL) {
+        struct test_node *tn = (struct test_node *)expired;
+
+        timer_wheel_remove(tw, expired);
+
+        if (tn->node.expires > now) {
+            printf("TEST: Node expiring at %llu expired at %llu\n",
+                   (unsigned long long)tn->node.expires, (unsigned long long)now);
+            result = false;
+        }
+        tn->expired = true;
+    }
+
+    return result;
+}
+
+static bool
+check_pending(struct test_node *nodes, size_t n, uint64_t now)
+{
+    size_t i;
+    bool result = true;
+
+    for (i = 0; i < n; i++) {
+        if (!nodes[i].expired && timer_wheel_is_pending(&nodes[i].node)
+            && (nodes[i].node.expires <= now)) {
+            printf("TEST: Node expiring at %llu still pending at %llu\n",
+                   (unsigned long long)nodes[i].node.expires, (unsigned long long)now);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+static bool
+test_fixed_deltas(void)
+{
+    static const uint64_t deltas[] = {
+        1, 2, 63, 64, 65, 4095, 4096, 4097, 54000, 262144, 3000000,
+        (uint64_t)1 << 33, ((uint64_t)1 << 36) + 5
+    };
+    struct test_node nodes[ARRAY_SIZE(deltas)] = {};
+    struct timer_wheel tw;
+    uint64_t tick, start = 123456;
+    bool result = true;
+    size_t i;
+
+    timer_wheel_init(&tw, start);
+
+    for (i = 0; i < ARRAY_SIZE(deltas); i++) {
+        timer_wheel_add(&tw, &nodes[i].node, start + deltas[i]);
+    }
+
+    /* Jump from event to event, as mainloop does */
+    while (timer_wheel_next_event(&tw, &tick)) {
+        result &= advance_and_check(&tw, tick);
+        result &= check_pending(nodes, ARRAY_SIZE(nodes), tick);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(nodes); i++) {
+        if (!nodes[i].expired) {
+            printf("TEST: Node %zu never expired\n", i);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+static bool
+test_remove(void)
+{
+    struct test_node a = {}, b = {}, c = {};
+    struct timer_wheel tw;
+    uint64_t tick;
+    bool result = true;
+
+    timer_wheel_init(&tw, 0);
+
+    timer_wheel_add(&tw, &a.node, 10);
+    timer_wheel_add(&tw, &b.node, 10);
+    timer_wheel_add(&tw, &c.node, 5000);
+
+    timer_wheel_remove(&tw, &b.node);
+    timer_wheel_remove(&tw, &c.node);
+    /* Removing twice is harmless */
+    timer_wheel_remove(&tw, &c.node);
+
+    result &= advance_and_check(&tw, 10000);
+
+    if (!a.expired || b.expired || c.expired) {
+        printf("TEST: Unexpected expiration after removal\n");
+        result = false;
+    }
+
+    if (timer_wheel_next_event(&tw, &tick)) {
+        printf("TEST: Empty wheel has next event at %llu\n", (unsigned long long)tick);
+        result = false;
+    }
+
+    return result;
+}
+
+static bool
+test_past_due(void)
+{
+    struct test_node a = {};
+    struct timer_wheel tw;
+    uint64_t tick;
+    bool result = true;
+
+    timer_wheel_init(&tw, 1000);
+    timer_wheel_add(&tw, &a.node, 10);
+
+    if (!timer_wheel_next_event(&tw, &tick) || (tick != 1000)) {
+        printf("TEST: Past due node not due now\n");
+        result = false;
+    }
+
+    result &= advance_and_check(&tw, 1000);
+    if (!a.expired) {
+        printf("TEST: Past due node didn't expire\n");
+        result = false;
+    }
+
+    return result;
+}
+
+static bool
+test_random(void)
+{
+    static struct test_node nodes[RANDOM_NODES];
+    struct timer_wheel tw;
+    uint64_t now = 0;
+    bool result = true;
+    size_t i;
+
+    srand(42);
+    timer_wheel_init(&tw, now);
+
+    for (i = 0; i < RANDOM_NODES; i++) {
+        uint64_t delta = ((uint64_t)rand() % 100000) + 1;
+
+        timer_wheel_add(&tw, &nodes[i].node, now + delta);
+        /* Remove some of them, to test bookkeeping of bitmaps */
+        if ((i % 7) == 0) {
+            timer_wheel_remove(&tw, &nodes[i].node);
+        }
+    }
+
+    /* Advance using arbitrary steps, not only from event to event */
+    while (now < 200000) {
+        now += ((uint64_t)rand() % 3000) + 1;
+        result &= advance_and_check(&tw, now);
+        result &= check_pending(nodes, RANDOM_NODES, now);
+    }
+
+    for (i = 0; i < RANDOM_NODES; i++) {
+        bool removed = (i % 7) == 0;
+
+        if (nodes[i].expired == removed) {
+            printf("TEST: Node %zu has wrong expired state\n", i);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+int main(void)
+{
+    bool success = true;
+
+    success &= test_fixed_deltas();
+    success &= test_remove();
+    success &= test_past_due();
+    success &= test_random();
+
+    if (success) {
+        printf("All tests OK\n");
+    } else {
+        printf("Some tests FAIL\n");
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2018 Intel Corporation
+# SPDX-License-Identifier: MIT
+#
+# Renders a timeline dumped by init (/run/u-nit-timeline) as a bootchart
+# like SVG: one bar per init phase and per process, from spawn to exit, with
+# readiness and stop requests marked on them, and stage changes as vertical
+# lines.
+#
+# Usage: timeline-svg.py [-s px-per-ms] [timeline] > timeline.svg
+
+import argparse
+import sys
+from xml.sax.saxutils import escape
+
+ROW_HEIGHT = 18
+LABEL_WIDTH = 360
+TOP = 30
+
+
+class Bar:
+    def __init__(self, label, start, kind, name=None):
+        self.label = label
+        self.name = name
+        self.start = start
+        self.end = None
+        self.kind = kind
+        self.status = None
+        self.marks = []
+
+
+def parse(lines):
+    events = []
+    for line in lines:
+        if line.startswith('#') or not line.strip():
+            continue
+        usec, kind, pid, value, name = line.rstrip('\n').split('\t', 4)
+        events.append((int(usec), kind, int(pid), int(value), name))
+    return events
+
+
+def build(events):
+    bars, open_phases, by_pid, stages = [], {}, {}, []
+
+    for usec, kind, pid, value, name in events:
+        if kind == 'begin':
+            bar = Bar(name, usec, 'phase')
+            open_phases[name] = bar
+            bars.append(bar)
+        elif kind == 'end' and name in open_phases:
+            open_phases.pop(name).end = usec
+        elif kind == 'stage':
+            stages.append((usec, name))
+        elif kind == 'spawn' and pid > 0:
+            bar = Bar('[%d] %s' % (pid, name), usec, 'process', name)
+            by_pid[pid] = bar
+            bars.append(bar)
+        elif kind == 'spawn':
+            bar = Bar('(failed) %s' % name, usec, 'failed')
+            bar.end = usec
+            bars.append(bar)
+        elif kind == 'ready' and pid in by_pid:
+            by_pid[pid].marks.append((usec, 'ready'))
+        elif kind == 'exit' and pid in by_pid:
+            bar = by_pid.pop(pid)
+            bar.end = usec
+            bar.status = value
+        elif kind == 'stop':
+            for bar in by_pid.values():
+                if bar.name == name:
+                    bar.marks.append((usec, 'kill' if value == 9 else 'stop'))
+
+    return bars, stages
+
+
+def render(events, scale, out):
+    bars, stages = build(events)
+    t0 = events[0][0]
+    t_end = events[-1][0]
+
+    def x(usec):
+        return LABEL_WIDTH + (usec - t0) / 1000.0 * scale
+
+    width = x(t_end) + 40
+    height = TOP + len(bars) * ROW_HEIGHT + 20
+
+    out.write('<svg xmlns="http://www.w3.org/2000/svg" width="%d" '
+              'height="%d" font-family="monospace" font-size="11">\n' %
+              (width, height))
+    out.write('<rect width="100%" height="100%" fill="white"/>\n')
+
+    # Time axis, every 100 ms
+    step = 100000
+    t = 0
+    while t0 + t <= t_end:
+        out.write('<line x1="%.1f" y1="%d" x2="%.1f" y2="%d" stroke="#eee"/>\n'
+                  % (x(t0 + t), TOP - 5, x(t0 + t), height))
+        out.write('<text x="%.1f" y="%d">%d ms</text>\n' %
+                  (x(t0 + t) + 2, TOP - 8, t // 1000))
+        t += step
+
+    for i, bar in enumerate(bars):
+        y = TOP + i * ROW_HEIGHT
+        end = bar.end if bar.end is not None else t_end
+        color = {'phase': '#9c9', 'process': '#99c', 'failed': '#c66'}[bar.kind]
+        if bar.status is not None and bar.status != 0:
+            color = '#c99'
+        out.write('<text x="4" y="%d">%s</text>\n' %
+                  (y + 12, escape(bar.label[:55])))
+        out.write('<rect x="%.1f" y="%d" width="%.1f" height="%d" '
+                  'fill="%s"><title>%s: %.1f ms</title></rect>\n' %
+                  (x(bar.start), y + 2, max(x(end) - x(bar.start), 1),
+                   ROW_HEIGHT - 4, color, escape(bar.label),
+                   (end - bar.start) / 1000.0))
+        for usec, mark in bar.marks:
+            out.write('<line x1="%.1f" y1="%d" x2="%.1f" y2="%d" '
+                      'stroke="%s" stroke-width="2"><title>%s</title>'
+                      '</line>\n' %
+                      (x(usec), y, x(usec), y + ROW_HEIGHT,
+                       {'ready': 'green', 'stop': 'orange',
+                        'kill': 'red'}[mark], mark))
+
+    for usec, name in stages:
+        out.write('<line x1="%.1f" y1="%d" x2="%.1f" y2="%d" stroke="black" '
+                  'stroke-dasharray="4,3"/>\n' %
+                  (x(usec), TOP - 5, x(usec), height))
+        out.write('<text x="%.1f" y="%d" fill="black">%s</text>\n' %
+                  (x(usec) + 2, height - 4, escape(name)))
+
+    out.write('</svg>\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Render init timeline')
+    parser.add_argument('-s', '--scale', type=float, default=1.0,
+                        help='pixels per millisecond')
+    parser.add_argument('timeline', nargs='?', default='/run/u-nit-timeline')
+    args = parser.parse_args()
+
+    with open(args.timeline) as f:
+        events = parse(f)
+
+    if not events:
+        sys.exit('No events on %s' % args.timeline)
+
+    render(events, args.scale, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()